@@ -1,5 +1,10 @@
 #include "client.h"
 #include "requirements.h"
+#include "timing.h"
+#include "netstats.h"
+#include "offload.h"
+
+#include <poll.h>
 
 void start_tcp_client(char *server_address, int port, void *config) {
     int sock;
@@ -15,16 +20,19 @@ void start_tcp_client(char *server_address, int port, void *config) {
     server_addr.sin_port = htons(port);
     inet_pton(AF_INET, server_address, &server_addr.sin_addr);
 
+    // the handshake takes one round trip; it seeds the socket buffer sizing on both ends
+    uint64_t connect_start = now_ns();
     if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Connection failed");
         exit(EXIT_FAILURE);
     }
+    ((Config *)config)->rtt_us = (int)((now_ns() - connect_start) / NSEC_PER_USEC);
 
-    printf("Connected to server. Sending config...\n");
+    printf("Connected to server (RTT %.3f ms). Sending config...\n", ((Config *)config)->rtt_us / 1000.0);
 
 
     Header header;
-    header.msg_type = htons(1);  
+    header.msg_type = htons(MSG_CONFIG);  
     header.msg_length = htons(sizeof(Config)); 
     header.timestamp = htonl(time(NULL));
 
@@ -52,30 +60,52 @@ void start_tcp_client(char *server_address, int port, void *config) {
 
 
 void udp_sender(const char *dest_ip, int port, int packet_size, 
-    uint64_t bandwidth_bps, double duration_sec) {
+    uint64_t bandwidth_bps, double duration_sec, uint64_t rtt_ns, int gso, volatile uint64_t *progress_bytes,
+    TestResult *result) {
     int sockfd;
     struct sockaddr_in server_addr;
     char *packet;
     uint32_t seq = 0;
-    struct timeval start_time, current_time;
+    uint64_t start_ns, elapsed_ns;
+    uint64_t duration_ns = (uint64_t)(duration_sec * NSEC_PER_SEC);
     double elapsed_seconds;
     uint64_t total_bits_sent = 0;
     uint64_t target_total_bits = bandwidth_bps * duration_sec;
     uint64_t packets_sent = 0;
     uint64_t total_bytes_per_packet;
-    double time_per_packet;
-    double next_send_time = 0;
+    uint64_t ns_per_packet, ns_remainder, remainder_acc = 0;
+    uint64_t next_send_ns = 0;
+    uint64_t backpressure_events = 0;   // ENOBUFS/EAGAIN from sendto
+    int segments = 1;                   // datagrams per sendto, >1 with UDP GSO
+    UdpSnmp snmp_before, snmp_after;
 
 
     total_bytes_per_packet = packet_size + TOTAL_HEADER_SIZE;
 
-    time_per_packet = (total_bytes_per_packet * 8.0) / bandwidth_bps;
+    // inter-packet gap as an exact fraction: ns_per_packet + ns_remainder/bandwidth_bps
+    ns_per_packet = (total_bytes_per_packet * 8 * NSEC_PER_SEC) / bandwidth_bps;
+    ns_remainder = (total_bytes_per_packet * 8 * NSEC_PER_SEC) % bandwidth_bps;
 
     if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
     perror("socket creation failed");
     exit(EXIT_FAILURE);
     }
 
+    // non-blocking so a full send buffer shows up as EAGAIN instead of a stall
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+    if (gso) {
+        segments = gso_segments_for(packet_size);
+        if (segments > 1 && enable_udp_gso(sockfd, packet_size) < 0) {
+            perror("UDP_SEGMENT not available, sending per packet");
+            segments = 1;
+        }
+    }
+
+    uint64_t sndbuf_wanted = sockbuf_for_rate(bandwidth_bps, rtt_ns);
+    int sndbuf = size_socket_buffer(sockfd, SO_SNDBUF, sndbuf_wanted);
+
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(port);
@@ -85,7 +115,7 @@ void udp_sender(const char *dest_ip, int port, int packet_size,
         exit(EXIT_FAILURE);
     }
 
-    packet = malloc(packet_size);
+    packet = malloc((size_t)packet_size * segments);
     if (!packet) {
         perror("memory allocation failed");
         close(sockfd);
@@ -93,43 +123,71 @@ void udp_sender(const char *dest_ip, int port, int packet_size,
     }
 
 
-    for (int i = sizeof(uint32_t); i < packet_size; i++) {
-        packet[i] = (char)(i % 256);
+    for (int k = 0; k < segments; k++) {
+        for (int i = sizeof(uint32_t); i < packet_size; i++) {
+            packet[k * packet_size + i] = (char)(i % 256);
+        }
     }
 printf("Sending UDP packets to %s:%d\n", dest_ip, port);
 printf("Packet size: %d bytes (+%d headers = %lu total)\n", 
 packet_size, TOTAL_HEADER_SIZE, total_bytes_per_packet);
 printf("Target bandwidth: %.2f Mbps (%.0f bps)\n", 
 bandwidth_bps/1000000.0, (double)bandwidth_bps);
-printf("Duration: %.2f seconds\n\n", duration_sec);
+printf("Duration: %.2f seconds\n", duration_sec);
+printf("Send buffer: %d bytes effective (wanted %lu, RTT %.3f ms)\n",
+sndbuf, sndbuf_wanted, rtt_ns / 1e6);
+if (segments > 1)
+    printf("UDP GSO: %d segments of %d bytes per send\n", segments, packet_size);
+printf("\n");
 
-gettimeofday(&start_time, NULL);
+udp_snmp_read(&snmp_before);
+start_ns = now_ns();
 
 while (1) {
-    gettimeofday(&current_time, NULL);
-    elapsed_seconds = (current_time.tv_sec - start_time.tv_sec) +
-                (current_time.tv_usec - start_time.tv_usec) / 1000000.0;
+    elapsed_ns = now_ns() - start_ns;
 
-    if (elapsed_seconds >= duration_sec) {
+    if (elapsed_ns >= duration_ns) {
         break;
     }
 
-    if (elapsed_seconds >= next_send_time) {
-    *(uint32_t*)packet = htonl(seq++);
+    if (elapsed_ns >= next_send_ns) {
+    for (int k = 0; k < segments; k++) {
+        *(uint32_t*)(packet + k * packet_size) = htonl(seq + k);
+    }
 
-    if (sendto(sockfd, packet, packet_size, 0, 
+    if (sendto(sockfd, packet, (size_t)packet_size * segments, 0, 
             (const struct sockaddr *)&server_addr, 
             sizeof(server_addr)) < 0) {
+        if (errno == ENOBUFS || errno == EAGAIN || errno == EWOULDBLOCK) {
+            // retry the same sequence numbers on the next pass
+            backpressure_events++;
+            continue;
+        }
+        if (segments > 1 && (errno == EINVAL || errno == EIO || errno == EMSGSIZE)) {
+            // UDP_SEGMENT was accepted but the segments do not fit the path MTU or the device
+            perror("UDP GSO send failed, sending per packet");
+            disable_udp_gso(sockfd);
+            segments = 1;
+            continue;
+        }
         perror("sendto failed");
         break;
     }
 
-    packets_sent++;
-    total_bits_sent += total_bytes_per_packet * 8;
+    seq += segments;
+    packets_sent += segments;
+    total_bits_sent += segments * total_bytes_per_packet * 8;
 
-    next_send_time = packets_sent * time_per_packet;
+    next_send_ns += ns_per_packet * segments;
+    remainder_acc += ns_remainder * segments;
+    while (remainder_acc >= bandwidth_bps) {
+        remainder_acc -= bandwidth_bps;
+        next_send_ns++;
+    }
 
-    if (packets_sent % 1000 == 0) {
+    if (progress_bytes) {
+        __atomic_store_n(progress_bytes, total_bits_sent / 8, __ATOMIC_RELAXED);
+    } else if (packets_sent % 1000 < (uint64_t)segments) {
         printf("Sent %lu packets (%.2f%% of target bandwidth)\r",
             packets_sent, 
             (double)total_bits_sent * 100.0 / target_total_bits);
@@ -141,8 +199,8 @@ while (1) {
 }
 
 
-gettimeofday(&current_time, NULL);
-elapsed_seconds = (current_time.tv_sec - start_time.tv_sec) + (current_time.tv_usec - start_time.tv_usec) / 1000000.0;
+elapsed_seconds = ns_to_sec(now_ns() - start_ns);
+udp_snmp_read(&snmp_after);
 
 double actual_bandwidth = (total_bits_sent / elapsed_seconds);
 double percentage_of_target = (actual_bandwidth / bandwidth_bps) * 100.0;
@@ -156,6 +214,17 @@ printf("Actual bandwidth:       %.2f Mbps (%.2f%% of target)\n",
 actual_bandwidth / 1000000.0, percentage_of_target);
 printf("Average packet rate:    %.2f packets/sec\n",
 packets_sent / elapsed_seconds);
+printf("Backpressure events:    %lu (ENOBUFS/EAGAIN)\n", backpressure_events);
+udp_snmp_report(&snmp_before, &snmp_after);
+
+if (result) {
+    memset(result, 0, sizeof(*result));
+    result->packets = packets_sent;
+    result->payload_bytes = packets_sent * packet_size;
+    result->transmitted_bytes = packets_sent * total_bytes_per_packet;
+    result->backpressure = backpressure_events;
+    result->elapsed_sec = elapsed_seconds;
+}
 
 free(packet);
 close(sockfd);
@@ -173,7 +242,8 @@ void udp_client_duration(const char *server_ip, int port, double duration_sec) {
     socklen_t addr_len = sizeof(server_addr);
     char buffer[1024];
 
-    struct timeval start, end, current;
+    uint64_t start_ns;
+    uint64_t duration_ns = (uint64_t)(duration_sec * NSEC_PER_SEC);
     double rtt, one_way_delay;
     double delays[MAX_MEASUREMENTS];
     int count = 0;
@@ -188,18 +258,15 @@ void udp_client_duration(const char *server_ip, int port, double duration_sec) {
     server_addr.sin_port = htons(port);
     inet_pton(AF_INET, server_ip, &server_addr.sin_addr);
 
-    gettimeofday(&start, NULL);
+    start_ns = now_ns();
 
     while (1) {
-        gettimeofday(&current, NULL);
-        double elapsed = (current.tv_sec - start.tv_sec) + (current.tv_usec - start.tv_usec) / 1000000.0;
-        if (elapsed >= duration_sec || count >= MAX_MEASUREMENTS)
+        if (now_ns() - start_ns >= duration_ns || count >= MAX_MEASUREMENTS)
             break;
 
         strcpy(buffer, "Ping");
 
-        struct timeval t1, t2;
-        gettimeofday(&t1, NULL);
+        uint64_t t1 = now_ns();
 
         sendto(sockfd, buffer, strlen(buffer), 0,
                (const struct sockaddr *)&server_addr, sizeof(server_addr));
@@ -207,9 +274,9 @@ void udp_client_duration(const char *server_ip, int port, double duration_sec) {
         recvfrom(sockfd, buffer, sizeof(buffer), 0,
                  (struct sockaddr *)&server_addr, &addr_len);
 
-        gettimeofday(&t2, NULL);
+        uint64_t t2 = now_ns();
 
-        rtt = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+        rtt = (t2 - t1) / (double)NSEC_PER_MSEC;
         one_way_delay = rtt / 2.0;
 
         delays[count++] = one_way_delay;
@@ -235,4 +302,330 @@ void udp_client_duration(const char *server_ip, int port, double duration_sec) {
     printf("\n=== Summary ===\n");
     printf("Total measurements: %d\n", count);
     printf("Median One-Way Delay: %.3f ms\n", median);
-}
\ No newline at end of file
+}
+
+typedef struct {
+    uint32_t seq;
+    uint32_t reserved;
+    uint64_t tx_ns;
+} ProbePacket;
+
+typedef struct {
+    double *rtt_ms;
+    int count;
+    int capacity;
+    int lost;
+    uint32_t first_seq;     // echoes of probes sent before this series are ignored
+} ProbeSeries;
+
+enum { PROBE_ANSWERED = 0, PROBE_OUTSTANDING, PROBE_TIMED_OUT };
+
+// Probes go out on a fixed schedule and echoes are matched as they arrive, so a slow or
+// lost echo never holds up the next probe.
+typedef struct {
+    int sockfd;
+    struct sockaddr_in addr;
+    uint64_t timeout_ns;
+    uint32_t next_seq;
+    uint32_t expire_seq;    // oldest probe not yet checked against its deadline
+    uint64_t sent_ns[PROBE_LATE_WINDOW];
+    uint8_t state[PROBE_LATE_WINDOW];
+    int timeouts;           // cumulative, for the per-interval column
+    ProbeSeries *series;    // series new probes belong to
+    ProbeSeries loaded;
+    volatile int stop;
+    volatile uint64_t bulk_bytes;   // updated by udp_sender
+} ProbeContext;
+
+
+static void probe_series_add(ProbeSeries *series, double rtt_ms) {
+    if (series->count == series->capacity) {
+        int capacity = series->capacity ? series->capacity * 2 : 1024;
+        double *grown = realloc(series->rtt_ms, capacity * sizeof(double));
+        if (!grown) {
+            perror("memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        series->rtt_ms = grown;
+        series->capacity = capacity;
+    }
+    series->rtt_ms[series->count++] = rtt_ms;
+}
+
+// Nearest-rank percentile over an already sorted, non-empty array.
+static double percentile(const double *sorted, int count, double pct) {
+    int rank = (int)ceil(pct / 100.0 * count);
+    if (rank < 1)
+        rank = 1;
+    return sorted[rank - 1];
+}
+
+// Formats a percentile in ms, or "-" when there are no samples.
+static const char *format_percentile(char *buf, size_t len, const double *sorted, int count, double pct) {
+    if (count == 0)
+        snprintf(buf, len, "-");
+    else
+        snprintf(buf, len, "%.3f", percentile(sorted, count, pct));
+    return buf;
+}
+
+static void probe_start_series(ProbeContext *ctx, ProbeSeries *series) {
+    ctx->series = series;
+    series->first_seq = ctx->next_seq;
+    ctx->expire_seq = ctx->next_seq;
+}
+
+static void probe_send(ProbeContext *ctx) {
+    ProbePacket probe;
+    uint32_t seq = ctx->next_seq++;
+    uint32_t slot = seq % PROBE_LATE_WINDOW;
+
+    probe.seq = htonl(seq);
+    probe.reserved = 0;
+    probe.tx_ns = now_ns();
+    ctx->sent_ns[slot] = probe.tx_ns;
+    ctx->state[slot] = PROBE_OUTSTANDING;
+
+    // a failed send is left to time out like a lost probe
+    sendto(ctx->sockfd, &probe, sizeof(probe), 0,
+           (const struct sockaddr *)&ctx->addr, sizeof(ctx->addr));
+}
+
+// Records an echo with its real RTT. A late echo of a timed-out probe turns that loss
+// into a sample; duplicates and echoes from an earlier series are ignored.
+static void probe_echo(ProbeContext *ctx, const ProbePacket *reply, uint64_t now) {
+    uint32_t seq = ntohl(reply->seq);
+    uint8_t *state = &ctx->state[seq % PROBE_LATE_WINDOW];
+    ProbeSeries *series = ctx->series;
+
+    if (seq - series->first_seq >= ctx->next_seq - series->first_seq
+            || ctx->next_seq - seq > PROBE_LATE_WINDOW || *state == PROBE_ANSWERED)
+        return;
+    if (*state == PROBE_TIMED_OUT)
+        series->lost--;
+    *state = PROBE_ANSWERED;
+    probe_series_add(series, (now - reply->tx_ns) / (double)NSEC_PER_MSEC);
+}
+
+// Probes still unanswered after the timeout count as lost.
+static void probe_expire(ProbeContext *ctx, uint64_t now) {
+    while (ctx->expire_seq != ctx->next_seq) {
+        uint32_t slot = ctx->expire_seq % PROBE_LATE_WINDOW;
+        if (now - ctx->sent_ns[slot] < ctx->timeout_ns)
+            break;
+        if (ctx->state[slot] == PROBE_OUTSTANDING) {
+            ctx->state[slot] = PROBE_TIMED_OUT;
+            ctx->series->lost++;
+            ctx->timeouts++;
+        }
+        ctx->expire_seq++;
+    }
+}
+
+// Collects echoes until until_ns.
+static void probe_receive(ProbeContext *ctx, uint64_t until_ns) {
+    struct pollfd pfd = { ctx->sockfd, POLLIN, 0 };
+    ProbePacket reply;
+    uint64_t now = now_ns();
+
+    do {
+        int wait_ms = until_ns > now ? (int)((until_ns - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC) : 0;
+        if (poll(&pfd, 1, wait_ms) > 0) {
+            while (recv(ctx->sockfd, &reply, sizeof(reply), MSG_DONTWAIT) == sizeof(reply))
+                probe_echo(ctx, &reply, now_ns());
+        }
+        now = now_ns();
+        probe_expire(ctx, now);
+    } while (now < until_ns);
+}
+
+// After the last probe of a series: wait until every probe is answered or has timed out.
+static void probe_drain(ProbeContext *ctx) {
+    while (ctx->expire_seq != ctx->next_seq) {
+        uint32_t slot = ctx->expire_seq % PROBE_LATE_WINDOW;
+        if (ctx->state[slot] != PROBE_OUTSTANDING) {
+            ctx->expire_seq++;
+            continue;
+        }
+        probe_receive(ctx, now_ns() + PROBE_INTERVAL_US * NSEC_PER_USEC);
+    }
+}
+
+static void probe_for(ProbeContext *ctx, ProbeSeries *series, uint64_t duration_ns) {
+    uint64_t start_ns = now_ns();
+    uint64_t next_send = start_ns;
+
+    probe_start_series(ctx, series);
+    while (next_send - start_ns < duration_ns) {
+        probe_send(ctx);
+        next_send += PROBE_INTERVAL_US * NSEC_PER_USEC;
+        probe_receive(ctx, next_send);
+    }
+    probe_drain(ctx);
+}
+
+// The server binds its echo socket only after the control connection closes, so probes
+// sent before the first reply are not counted. Returns 0 once any echo came back.
+static int wait_for_echo(ProbeContext *ctx) {
+    struct pollfd pfd = { ctx->sockfd, POLLIN, 0 };
+    uint64_t start_ns = now_ns();
+    ProbePacket probe, reply;
+
+    while (now_ns() - start_ns < ECHO_READY_TIMEOUT_SEC * NSEC_PER_SEC) {
+        probe.seq = htonl(ctx->next_seq++);
+        probe.reserved = 0;
+        probe.tx_ns = now_ns();
+        sendto(ctx->sockfd, &probe, sizeof(probe), 0,
+               (const struct sockaddr *)&ctx->addr, sizeof(ctx->addr));
+        if (poll(&pfd, 1, ECHO_READY_POLL_US / 1000) > 0
+                && recv(ctx->sockfd, &reply, sizeof(reply), MSG_DONTWAIT) == sizeof(reply))
+            return 0;
+    }
+    return -1;
+}
+
+static void print_latency_summary(const char *label, ProbeSeries *series) {
+    char p50[16], p90[16], p99[16], max[16];
+
+    qsort(series->rtt_ms, series->count, sizeof(double), compare_doubles);
+    printf("%-8s probes %5d  lost %4d  p50 %8s  p90 %8s  p99 %8s  max %8s ms\n",
+           label, series->count, series->lost,
+           format_percentile(p50, sizeof(p50), series->rtt_ms, series->count, 50),
+           format_percentile(p90, sizeof(p90), series->rtt_ms, series->count, 90),
+           format_percentile(p99, sizeof(p99), series->rtt_ms, series->count, 99),
+           format_percentile(max, sizeof(max), series->rtt_ms, series->count, 100));
+}
+
+typedef struct {
+    double start_sec;
+    uint64_t prev_bytes;
+    int first;          // index of the interval's first sample in the loaded series
+    int prev_timeouts;
+    double *scratch;
+} ProbeInterval;
+
+static void print_probe_interval(ProbeContext *ctx, ProbeInterval *iv, double end_sec) {
+    ProbeSeries *series = &ctx->loaded;
+    uint64_t bytes = __atomic_load_n(&ctx->bulk_bytes, __ATOMIC_RELAXED);
+    int n = series->count - iv->first;
+
+    iv->scratch = realloc(iv->scratch, (n ? n : 1) * sizeof(double));
+    memcpy(iv->scratch, series->rtt_ms + iv->first, n * sizeof(double));
+    qsort(iv->scratch, n, sizeof(double), compare_doubles);
+
+    char p50[16], p99[16];
+    printf("[%5.1f-%5.1f s] %12.3f %7d %7d %7s ms %7s ms\n",
+           iv->start_sec, end_sec,
+           (bytes - iv->prev_bytes) * 8.0 / ((end_sec - iv->start_sec) * 1e6),
+           n, ctx->timeouts - iv->prev_timeouts,
+           format_percentile(p50, sizeof(p50), iv->scratch, n, 50),
+           format_percentile(p99, sizeof(p99), iv->scratch, n, 99));
+    fflush(stdout);
+
+    iv->start_sec = end_sec;
+    iv->prev_bytes = bytes;
+    iv->first = series->count;
+    iv->prev_timeouts = ctx->timeouts;
+}
+
+// Probes while the bulk stream runs and prints per-second rate next to latency.
+// Samples land in the interval their echo arrives in; Timeout counts probes whose
+// deadline passed in it, even if a late echo still adds a sample afterwards.
+static void *loaded_probe_thread(void *arg) {
+    ProbeContext *ctx = arg;
+    ProbeSeries *series = &ctx->loaded;
+    uint64_t start_ns = now_ns();
+    uint64_t next_send = start_ns;
+    uint64_t interval_end = start_ns + NSEC_PER_SEC;
+    ProbeInterval iv = {0};
+
+    probe_start_series(ctx, series);
+    iv.prev_timeouts = ctx->timeouts;
+
+    printf("\n%-15s %12s %7s %7s %10s %10s\n",
+           "Interval", "Sent Mbps", "Probes", "Timeout", "RTT p50", "RTT p99");
+
+    while (!ctx->stop) {
+        probe_send(ctx);
+        next_send += PROBE_INTERVAL_US * NSEC_PER_USEC;
+
+        while (next_send > interval_end) {
+            probe_receive(ctx, interval_end);
+            print_probe_interval(ctx, &iv, ns_to_sec(now_ns() - start_ns));
+            interval_end += NSEC_PER_SEC;
+        }
+        probe_receive(ctx, next_send);
+    }
+
+    // trailing partial interval; probes still in flight only reach the summary
+    double end_sec = ns_to_sec(now_ns() - start_ns);
+    if ((series->count > iv.first || ctx->timeouts > iv.prev_timeouts) && end_sec > iv.start_sec)
+        print_probe_interval(ctx, &iv, end_sec);
+    probe_drain(ctx);
+
+    free(iv.scratch);
+    return NULL;
+}
+
+void udp_latency_under_load(const char *server_ip, int port, int packet_size,
+    uint64_t bandwidth_bps, double duration_sec, uint64_t rtt_ns, int gso, int probe_timeout_ms) {
+    ProbeContext *ctx = calloc(1, sizeof(ProbeContext));
+    ProbeSeries idle = {0};
+    pthread_t tid;
+
+    if (!ctx) {
+        perror("memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((ctx->sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("socket failed");
+        exit(EXIT_FAILURE);
+    }
+    ctx->timeout_ns = (uint64_t)probe_timeout_ms * NSEC_PER_MSEC;
+
+    ctx->addr.sin_family = AF_INET;
+    ctx->addr.sin_port = htons(port + PROBE_PORT_OFFSET);
+    if (inet_pton(AF_INET, server_ip, &ctx->addr.sin_addr) <= 0) {
+        perror("invalid address");
+        close(ctx->sockfd);
+        exit(EXIT_FAILURE);
+    }
+
+    if (wait_for_echo(ctx) < 0)
+        printf("Warning: no echo from %s:%d after %d seconds\n",
+               server_ip, port + PROBE_PORT_OFFSET, ECHO_READY_TIMEOUT_SEC);
+
+    printf("Measuring idle latency for %d seconds...\n", IDLE_BASELINE_SEC);
+    probe_for(ctx, &idle, IDLE_BASELINE_SEC * NSEC_PER_SEC);
+
+    if (pthread_create(&tid, NULL, loaded_probe_thread, ctx) != 0) {
+        perror("pthread_create failed");
+        close(ctx->sockfd);
+        exit(EXIT_FAILURE);
+    }
+
+    udp_sender(server_ip, port, packet_size, bandwidth_bps, duration_sec, rtt_ns, gso, &ctx->bulk_bytes, NULL);
+
+    ctx->stop = 1;
+    pthread_join(tid, NULL);
+    close(ctx->sockfd);
+
+    printf("\n=== Latency Under Load (RTT) ===\n");
+    print_latency_summary("Idle", &idle);
+    print_latency_summary("Loaded", &ctx->loaded);
+
+    if (idle.count > 0 && ctx->loaded.count > 0) {
+        double idle_p50 = percentile(idle.rtt_ms, idle.count, 50);
+        double loaded_p50 = percentile(ctx->loaded.rtt_ms, ctx->loaded.count, 50);
+        double idle_p99 = percentile(idle.rtt_ms, idle.count, 99);
+        double loaded_p99 = percentile(ctx->loaded.rtt_ms, ctx->loaded.count, 99);
+
+        printf("Latency increase:  p50 %+.3f ms  p99 %+.3f ms\n",
+               loaded_p50 - idle_p50, loaded_p99 - idle_p99);
+    }
+
+    free(idle.rtt_ms);
+    free(ctx->loaded.rtt_ms);
+    free(ctx);
+}
@@ -2,9 +2,18 @@
 #define CLIENT_H
 
 #include <stdint.h>
+#include "requirements.h"
 
 #define MAX_MEASUREMENTS 10000
 
+#define PROBE_INTERVAL_US 10000  // latency probe rate while under load
+#define PROBE_TIMEOUT_MS 3000    // default -T: a probe without a reply by then counts as lost
+#define PROBE_TIMEOUT_MAX_MS 60000
+#define PROBE_LATE_WINDOW 8192   // probes tracked at once; covers PROBE_TIMEOUT_MAX_MS at PROBE_INTERVAL_US
+#define IDLE_BASELINE_SEC 2      // idle latency measured before the bulk stream starts
+#define ECHO_READY_TIMEOUT_SEC 5 // how long to wait for the server's echo socket to come up
+#define ECHO_READY_POLL_US 100000 // probe spacing while waiting for it
+
 
 void start_tcp_client(char *server_address, int port, void *config);
 
@@ -13,7 +22,16 @@ int compare_doubles(const void *a, const void *b);
 void udp_client_duration(const char *server_ip, int port, double duration_sec);
 
 
+// rtt_ns sizes the send buffer (see sockbuf_for_rate).
+// gso sends super-buffers of packet_size segments with UDP_SEGMENT.
+// progress_bytes, if not NULL, receives the running byte count and silences the progress line.
+// result, if not NULL, receives the totals.
 void udp_sender(const char *dest_ip, int port, int packet_size, 
-    uint64_t bandwidth_bps, double duration_sec);
+    uint64_t bandwidth_bps, double duration_sec, uint64_t rtt_ns, int gso, volatile uint64_t *progress_bytes,
+    TestResult *result);
+
+// Probes unanswered after probe_timeout_ms count as lost until their echo shows up.
+void udp_latency_under_load(const char *server_ip, int port, int packet_size,
+    uint64_t bandwidth_bps, double duration_sec, uint64_t rtt_ns, int gso, int probe_timeout_ms);
 
 #endif
\ No newline at end of file
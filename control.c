@@ -0,0 +1,62 @@
+#include "control.h"
+#include "requirements.h"
+
+#include <time.h>
+
+
+int send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int recv_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int send_message(int fd, uint16_t type, const void *payload, uint16_t len) {
+    Header header;
+
+    header.msg_type = htons(type);
+    header.msg_length = htons(len);
+    header.timestamp = htonl(time(NULL));
+
+    if (send_all(fd, &header, sizeof(header)) < 0)
+        return -1;
+    return len ? send_all(fd, payload, len) : 0;
+}
+
+int recv_message(int fd, uint16_t *type, void *payload, uint16_t max) {
+    Header header;
+
+    if (recv_all(fd, &header, sizeof(header)) < 0)
+        return -1;
+
+    uint16_t len = ntohs(header.msg_length);
+    *type = ntohs(header.msg_type);
+    if (len > max)
+        return -1;
+    if (len && recv_all(fd, payload, len) < 0)
+        return -1;
+    return len;
+}
@@ -0,0 +1,18 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Loop until all len bytes went through; a short TCP read or write is not an error.
+// Return 0, or -1 if the connection broke.
+int send_all(int fd, const void *buf, size_t len);
+int recv_all(int fd, void *buf, size_t len);
+
+// Header-framed control messages.
+int send_message(int fd, uint16_t type, const void *payload, uint16_t len);
+
+// Returns the payload length, or -1 if the connection broke or the payload does not fit.
+int recv_message(int fd, uint16_t *type, void *payload, uint16_t max);
+
+#endif
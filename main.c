@@ -1,19 +1,30 @@
 #include "client.h"
 #include "server.h"
 #include "requirements.h"
+#include "timing.h"
+#include "relay.h"
+#include "scenario.h"
+#include "netstats.h"
 
 void print_config(Config *config) {
-    printf("Mode: %s\n", config->is_server ? "Server" : (config->is_client ? "Client" : "Unknown"));
+    printf("Mode: %s\n", config->is_server ? "Server" : (config->is_client ? "Client" : (config->is_relay ? "Relay" : "Unknown")));
     if (config->address) printf("Address: %s\n", config->address);
     if (config->port) printf("Port: %d\n", config->port);
     if (config->interval) printf("Interval: %d sec\n", config->interval);
     if (config->filename) printf("Output File: %s\n", config->filename);
     if (config->udp_packet_size) printf("UDP Packet Size: %d bytes\n", config->udp_packet_size);
-    if (config->bandwidth) printf("Bandwidth: %d bps\n", config->bandwidth);
+    if (config->bandwidth) printf("Bandwidth: %lu bps\n", config->bandwidth);
     if (config->num_streams) printf("Parallel Streams: %d\n", config->num_streams);
     if (config->duration) printf("Duration: %d sec\n", config->duration);
     if (config->measure_delay) printf("Measuring One-way Delay\n");
+    if (config->latency_under_load) printf("Measuring Latency Under Load\n");
+    if (config->probe_timeout_ms) printf("Probe Timeout: %d ms\n", config->probe_timeout_ms);
     if (config->wait_time) printf("Wait Time Before Start: %d sec\n", config->wait_time);
+    if (config->upstream_port) printf("Upstream Port: %d\n", config->upstream_port);
+    if (config->impairment) printf("Impairment: %s\n", config->impairment);
+    if (config->offload) printf("UDP GSO/GRO Offload\n");
+    if (config->scenario_file) printf("Scenario File: %s\n", config->scenario_file);
+    printf("Clock Source: %s\n", timing_source_name());
 }
 
 
@@ -24,7 +35,7 @@ int main(int argc, char *argv[]) {
     int opt;
     int client_s; 
 
-    while ((opt = getopt(argc, argv, "sca:p:i:f:l:b:n:t:dw:")) != -1) {
+    while ((opt = getopt(argc, argv, "scra:p:i:f:l:b:n:t:dw:BLT:u:I:GS:")) != -1) {
         switch (opt) {
             case 's':
                 config.is_server = 1;
@@ -32,6 +43,9 @@ int main(int argc, char *argv[]) {
             case 'c':
                 config.is_client = 1;
                 break;
+            case 'r':
+                config.is_relay = 1;
+                break;
             case 'a':
                 config.address = optarg;
                 break;
@@ -48,7 +62,10 @@ int main(int argc, char *argv[]) {
                 config.udp_packet_size = atoi(optarg);
                 break;
             case 'b':
-                config.bandwidth = atoi(optarg);
+                if (parse_rate(optarg, &config.bandwidth) < 0) {
+                    fprintf(stderr, "Error: bad bandwidth '%s' (bps with optional k/M/G suffix).\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
                 break;
             case 'n':
                 config.num_streams = atoi(optarg);
@@ -62,30 +79,90 @@ int main(int argc, char *argv[]) {
             case 'w':
                 config.wait_time = atoi(optarg);
                 break;
+            case 'B':
+                config.clock_bench = 1;
+                break;
+            case 'L':
+                config.latency_under_load = 1;
+                break;
+            case 'T':
+                config.probe_timeout_ms = atoi(optarg);
+                if (config.probe_timeout_ms <= 0 || config.probe_timeout_ms > PROBE_TIMEOUT_MAX_MS) {
+                    fprintf(stderr, "Error: probe timeout must be 1 to %d ms.\n", PROBE_TIMEOUT_MAX_MS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'u':
+                config.upstream_port = atoi(optarg);
+                break;
+            case 'I':
+                config.impairment = optarg;
+                break;
+            case 'G':
+                config.offload = 1;
+                break;
+            case 'S':
+                config.scenario_file = optarg;
+                break;
             default:
                 fprintf(stderr, "Usage: %s -s|-c [-a address] [-p port] ...\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
 
-    if (!config.is_server && !config.is_client) {
-        fprintf(stderr, "Error: You must specify either server (-s) or client (-c) mode.\n");
+    timing_init();
+
+    if (config.clock_bench) {
+        timing_benchmark();
+        return 0;
+    }
+
+    if (!config.is_server && !config.is_client && !config.is_relay) {
+        fprintf(stderr, "Error: You must specify server (-s), client (-c) or relay (-r) mode.\n");
         exit(EXIT_FAILURE);
     }
 
     print_config(&config);
 
+    if (config.is_relay) {
+        if (!config.address || !config.port || !config.upstream_port) {
+            fprintf(stderr, "Error: Relay mode requires server address (-a), listen port (-p) and upstream port (-u).\n");
+            exit(EXIT_FAILURE);
+        }
+        udp_relay(config.address, config.port, config.upstream_port, config.impairment);
+        return 0;
+    }
+
     if (config.is_server) {
         Config *recvd_conf;
-        recvd_conf = start_tcp_server(config.port ? config.port : PORT, recvd_conf);
+        int control_sock = -1;
+        struct sockaddr_in peer;
+        recvd_conf = start_tcp_server(config.port ? config.port : PORT, recvd_conf, &control_sock, &peer);
+        if (recvd_conf->scenario) {
+            scenario_server(control_sock, &peer, config.port ? config.port : PORT_UDP);
+            free(recvd_conf);
+            return 0;
+        }
         printf("Packet size :: %d\n", recvd_conf->udp_packet_size);
         printf("Na metrhsw to 1 way delay : %d\n\n\n", recvd_conf->measure_delay);
         // print_config(recvd_conf);
         // printf("Bandwidth :: %d\n", config.bandwidth);
-        if(recvd_conf->measure_delay){
+        if(recvd_conf->latency_under_load){
+            int udp_port = config.port ? config.port : PORT_UDP;
+            int probe_port = udp_port + PROBE_PORT_OFFSET;
+            pthread_t echo_tid;
+            if (pthread_create(&echo_tid, NULL, udp_server_thread, &probe_port) != 0) {
+                perror("pthread_create failed");
+                exit(EXIT_FAILURE);
+            }
+            udp_receiver(udp_port, recvd_conf->udp_packet_size ? recvd_conf->udp_packet_size : 1024, recvd_conf->duration ? recvd_conf->duration : 10,
+                recvd_conf->bandwidth ? recvd_conf->bandwidth : 1000000, (uint64_t)recvd_conf->rtt_us * NSEC_PER_USEC, recvd_conf->offload, 0, NULL);
+            pthread_join(echo_tid, NULL);
+        }else if(recvd_conf->measure_delay){
             udp_server(config.port ? config.port : PORT_UDP);
         }else{
-            udp_receiver(config.port ? config.port : PORT_UDP, recvd_conf->udp_packet_size ? recvd_conf->udp_packet_size : 1024, recvd_conf->duration ? recvd_conf->duration : 10);
+            udp_receiver(config.port ? config.port : PORT_UDP, recvd_conf->udp_packet_size ? recvd_conf->udp_packet_size : 1024, recvd_conf->duration ? recvd_conf->duration : 10,
+            recvd_conf->bandwidth ? recvd_conf->bandwidth : 1000000, (uint64_t)recvd_conf->rtt_us * NSEC_PER_USEC, recvd_conf->offload, 0, NULL);
         }
         }else if (config.is_client) {
         if (!config.address) {
@@ -96,12 +173,21 @@ int main(int argc, char *argv[]) {
         if(config.wait_time != 0){
             sleep(config.wait_time);
         }
+        if (config.scenario_file) {
+            run_scenario(config.address, config.port ? config.port : PORT, config.port ? config.port : PORT_UDP,
+                config.scenario_file, config.filename ? config.filename : SCENARIO_DEFAULT_OUTPUT);
+            return 0;
+        }
         start_tcp_client(config.address, config.port ? config.port : PORT,&config);
-        if(config.measure_delay){
+        if(config.latency_under_load){
+            udp_latency_under_load(config.address, config.port ? config.port : PORT_UDP, config.udp_packet_size ? config.udp_packet_size : 1024, config.bandwidth ? config.bandwidth : 1000000,
+            config.duration ? config.duration : 10, (uint64_t)config.rtt_us * NSEC_PER_USEC, config.offload,
+            config.probe_timeout_ms ? config.probe_timeout_ms : PROBE_TIMEOUT_MS);
+        }else if(config.measure_delay){
             udp_client_duration(config.address, config.port ? config.port : PORT_UDP, config.duration ? config.duration : 10);
         }else{        
             udp_sender(config.address,config.port ? config.port : PORT_UDP, config.udp_packet_size ? config.udp_packet_size : 1024, config.bandwidth ? config.bandwidth : 1000000, 
-            config.duration ? config.duration : 10);
+            config.duration ? config.duration : 10, (uint64_t)config.rtt_us * NSEC_PER_USEC, config.offload, NULL, NULL);
         }
     }
 
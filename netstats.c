@@ -0,0 +1,111 @@
+#include "netstats.h"
+#include "requirements.h"
+
+
+int udp_snmp_read(UdpSnmp *snmp) {
+    FILE *f = fopen("/proc/net/snmp", "r");
+    char names[512], values[512];
+
+    memset(snmp, 0, sizeof(*snmp));
+    if (!f)
+        return -1;
+
+    // the Udp section is a header line followed by a value line
+    while (fgets(names, sizeof(names), f)) {
+        if (strncmp(names, "Udp:", 4) != 0)
+            continue;
+        if (!fgets(values, sizeof(values), f))
+            break;
+
+        char *name_save = NULL, *value_save = NULL;
+        char *name = strtok_r(names + 4, " \n", &name_save);
+        char *value = strtok_r(values + 4, " \n", &value_save);
+
+        while (name && value) {
+            uint64_t v = strtoull(value, NULL, 10);
+
+            if (strcmp(name, "InDatagrams") == 0) snmp->in_datagrams = v;
+            else if (strcmp(name, "NoPorts") == 0) snmp->no_ports = v;
+            else if (strcmp(name, "InErrors") == 0) snmp->in_errors = v;
+            else if (strcmp(name, "OutDatagrams") == 0) snmp->out_datagrams = v;
+            else if (strcmp(name, "RcvbufErrors") == 0) snmp->rcvbuf_errors = v;
+            else if (strcmp(name, "SndbufErrors") == 0) snmp->sndbuf_errors = v;
+
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+        snmp->valid = 1;
+        break;
+    }
+
+    fclose(f);
+    return snmp->valid ? 0 : -1;
+}
+
+
+void udp_snmp_report(const UdpSnmp *before, const UdpSnmp *after) {
+    if (!before->valid || !after->valid) {
+        printf("\n/proc/net/snmp not available\n");
+        return;
+    }
+
+    printf("\nHost UDP counters during test (/proc/net/snmp):\n");
+    printf("InDatagrams:           %lu\n", after->in_datagrams - before->in_datagrams);
+    printf("OutDatagrams:          %lu\n", after->out_datagrams - before->out_datagrams);
+    printf("InErrors:              %lu\n", after->in_errors - before->in_errors);
+    printf("RcvbufErrors:          %lu\n", after->rcvbuf_errors - before->rcvbuf_errors);
+    printf("SndbufErrors:          %lu\n", after->sndbuf_errors - before->sndbuf_errors);
+    printf("NoPorts:               %lu\n", after->no_ports - before->no_ports);
+}
+
+
+int parse_rate(const char *value, uint64_t *rate_bps) {
+    char *end;
+    double rate = strtod(value, &end);
+
+    if (end == value || rate < 0)
+        return -1;
+    switch (*end) {
+        case 'k': case 'K': rate *= 1e3; end++; break;
+        case 'm': case 'M': rate *= 1e6; end++; break;
+        case 'g': case 'G': rate *= 1e9; end++; break;
+        default: break;
+    }
+    if (*end != '\0')
+        return -1;
+    *rate_bps = (uint64_t)rate;
+    return 0;
+}
+
+uint64_t sockbuf_for_rate(uint64_t rate_bps, uint64_t rtt_ns) {
+    uint64_t bytes = (uint64_t)((unsigned __int128)(rate_bps / 8) * (rtt_ns + SOCKBUF_SLACK_NS) * 2 / 1000000000ULL);
+
+    if (bytes < SOCKBUF_MIN)
+        bytes = SOCKBUF_MIN;
+    if (bytes > SOCKBUF_MAX)
+        bytes = SOCKBUF_MAX;
+    return bytes;
+}
+
+
+int size_socket_buffer(int fd, int optname, uint64_t bytes) {
+    int size = (int)bytes;
+    int force = optname == SO_RCVBUF ? SO_RCVBUFFORCE : SO_SNDBUFFORCE;
+    int effective = 0;
+    socklen_t len = sizeof(effective);
+
+    // FORCE needs CAP_NET_ADMIN; without it the request is capped at [rw]mem_max
+    if (setsockopt(fd, SOL_SOCKET, force, &size, sizeof(size)) < 0)
+        setsockopt(fd, SOL_SOCKET, optname, &size, sizeof(size));
+
+    // the kernel doubles the value to account for bookkeeping overhead
+    if (getsockopt(fd, SOL_SOCKET, optname, &effective, &len) < 0)
+        return -1;
+    return effective;
+}
+
+
+int enable_rxq_ovfl(int fd) {
+    int one = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+}
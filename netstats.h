@@ -0,0 +1,37 @@
+#ifndef NETSTATS_H
+#define NETSTATS_H
+
+#include <stdint.h>
+
+#define SOCKBUF_MIN (256 * 1024)
+#define SOCKBUF_MAX (256 * 1024 * 1024)
+#define SOCKBUF_SLACK_NS (10 * 1000000ULL)  // scheduling stalls the buffer must also absorb
+
+// Host-wide UDP counters from /proc/net/snmp.
+typedef struct {
+    int valid;
+    uint64_t in_datagrams;
+    uint64_t no_ports;
+    uint64_t in_errors;
+    uint64_t out_datagrams;
+    uint64_t rcvbuf_errors;
+    uint64_t sndbuf_errors;
+} UdpSnmp;
+
+int udp_snmp_read(UdpSnmp *snmp);
+
+void udp_snmp_report(const UdpSnmp *before, const UdpSnmp *after);
+
+// Parses plain bps or a k/M/G suffix, e.g. "2.5G". Returns 0 on success, -1 on anything else.
+int parse_rate(const char *value, uint64_t *rate_bps);
+
+// Buffer size for rate_bps over rtt_ns: twice the bandwidth-delay product plus slack.
+uint64_t sockbuf_for_rate(uint64_t rate_bps, uint64_t rtt_ns);
+
+// Sets SO_RCVBUF or SO_SNDBUF, preferring the *FORCE variant, and returns the size the kernel granted.
+int size_socket_buffer(int fd, int optname, uint64_t bytes);
+
+// Asks for the SO_RXQ_OVFL cmsg carrying the socket's cumulative drop counter.
+int enable_rxq_ovfl(int fd);
+
+#endif
@@ -0,0 +1,29 @@
+#include "offload.h"
+#include "requirements.h"
+
+
+int gso_segments_for(int packet_size) {
+    int segments = GSO_MAX_BYTES / packet_size;
+
+    if (segments > GSO_MAX_SEGMENTS)
+        segments = GSO_MAX_SEGMENTS;
+    return segments > 0 ? segments : 1;
+}
+
+
+int enable_udp_gso(int fd, int packet_size) {
+    int gso_size = packet_size;
+    return setsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size));
+}
+
+
+int disable_udp_gso(int fd) {
+    int off = 0;
+    return setsockopt(fd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off));
+}
+
+
+int enable_udp_gro(int fd) {
+    int one = 1;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+}
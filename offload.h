@@ -0,0 +1,33 @@
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define RECV_BUF_SIZE 65536      // largest UDP datagram, also the GRO super-buffer limit
+#define GSO_MAX_SEGMENTS 64      // UDP_MAX_SEGMENTS on older kernels
+#define GSO_MAX_BYTES 65000      // super-buffer payload must stay below the IP length limit
+
+// Segments per GSO super-buffer for packet_size-byte datagrams.
+int gso_segments_for(int packet_size);
+
+// Sets the default gso_size for every send on fd. Returns -1 if the kernel lacks UDP_SEGMENT.
+int enable_udp_gso(int fd, int packet_size);
+
+// Clears gso_size again, back to one datagram per send.
+int disable_udp_gso(int fd);
+
+// Lets the kernel coalesce received datagrams; the gso_size arrives as a UDP_GRO cmsg.
+int enable_udp_gro(int fd);
+
+#endif
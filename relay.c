@@ -0,0 +1,839 @@
+#define _GNU_SOURCE  // recvmmsg/sendmmsg
+#include "relay.h"
+#include "requirements.h"
+#include "timing.h"
+#include "netstats.h"
+
+#include <ctype.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define RELAY_BATCH 64
+#define RELAY_MAX_DGRAM 65536
+#define RELAY_POOL_SIZE 65536           // packets held in the delay line at once
+#define RELAY_WHEEL_SLOTS 65536         // power of two
+#define RELAY_TICK_NS (10 * NSEC_PER_USEC)
+#define RELAY_SOCKBUF (8 * 1024 * 1024)
+#define RELAY_NIL UINT32_MAX
+#define RELAY_TIMER_EVENT (2 * RELAY_CHANNELS)   // epoll data for the wheel timer
+
+#define DEFAULT_BURST_BYTES (64 * 1024)
+#define DEFAULT_QUEUE_NS (100 * NSEC_PER_MSEC)
+
+
+typedef struct {
+    char *data;
+    uint32_t len;
+    uint32_t cap;
+    uint64_t due_ns;
+    uint32_t next;
+    uint8_t channel;
+} RelayPacket;
+
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+} WheelSlot;
+
+typedef struct {
+    int listen_fd;      // faces the client
+    int upstream_fd;    // connected to the server
+    struct sockaddr_in client_addr;
+    int have_client;
+} RelayChannel;
+
+typedef struct {
+    uint64_t received;
+    uint64_t forwarded;
+    uint64_t returned;      // server->client, never impaired
+    uint64_t lost_random;
+    uint64_t lost_burst;
+    uint64_t lost_queue;    // token bucket queue overflow
+    uint64_t lost_pool;     // delay line full
+    uint64_t lost_send;     // sendmmsg to the server failed
+    uint64_t duplicated;
+    uint64_t reordered;
+} RelayStats;
+
+// Outgoing batch for one channel, flushed with sendmmsg.
+typedef struct {
+    struct mmsghdr msgs[RELAY_BATCH];
+    struct iovec iov[RELAY_BATCH];
+    uint32_t idx[RELAY_BATCH];
+    int count;
+} SendBatch;
+
+typedef struct {
+    Impairment imp;
+    RelayChannel chan[RELAY_CHANNELS];
+
+    RelayPacket *pool;
+    uint32_t free_head;
+    uint32_t pending;
+
+    WheelSlot *wheel;
+    uint64_t wheel_tick;    // first tick not yet fully processed
+
+    uint64_t rng;
+    int ge_bad;
+
+    // token bucket; credit is in bit-nanoseconds so refill is elapsed_ns * rate_bps
+    unsigned __int128 tb_credit;
+    unsigned __int128 tb_capacity;
+    uint64_t tb_last_ns;
+
+    SendBatch out[RELAY_CHANNELS];
+    struct mmsghdr rx_msgs[RELAY_BATCH];
+    struct iovec rx_iov[RELAY_BATCH];
+    struct sockaddr_in rx_addr[RELAY_BATCH];
+    char *rx_arena;
+
+    RelayStats stats;
+    uint64_t last_send_error_ns;
+} Relay;
+
+static volatile sig_atomic_t relay_stop = 0;
+
+static void relay_signal(int sig) {
+    (void)sig;
+    relay_stop = 1;
+}
+
+
+// Values are parsed strictly: trailing junk, negative times and out-of-range percentages
+// are rejected rather than silently changing the impairment. Each returns 0 or -1.
+static int parse_percent(const char *value, double *prob) {
+    char *end;
+    double pct = strtod(value, &end);
+
+    if (end == value || *end != '\0' || pct < 0.0 || pct > 100.0)
+        return -1;
+    *prob = pct / 100.0;
+    return 0;
+}
+
+static int parse_ms(const char *value, uint64_t *ns) {
+    char *end;
+    double ms = strtod(value, &end);
+
+    if (end == value || *end != '\0' || ms < 0.0)
+        return -1;
+    *ns = (uint64_t)(ms * NSEC_PER_MSEC);
+    return 0;
+}
+
+static int parse_count(const char *value, uint64_t *count) {
+    char *end;
+
+    if (!isdigit((unsigned char)*value))
+        return -1;
+    *count = strtoull(value, &end, 10);
+    return *end == '\0' ? 0 : -1;
+}
+
+int parse_impairment(const char *spec, Impairment *imp) {
+    memset(imp, 0, sizeof(*imp));
+    imp->ge_bad_loss = 1.0;
+    imp->burst_bytes = DEFAULT_BURST_BYTES;
+    imp->queue_ns = DEFAULT_QUEUE_NS;
+    imp->seed = 1;
+
+    if (!spec || !*spec)
+        return 0;
+
+    char *copy = strdup(spec);
+    char *saveptr = NULL;
+    int ret = 0;
+
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(tok, '=');
+        if (!value) {
+            fprintf(stderr, "Impairment '%s' needs a value\n", tok);
+            ret = -1;
+            break;
+        }
+        *value++ = '\0';
+
+        int bad = 0;
+        if (strcmp(tok, "delay") == 0) {
+            bad = parse_ms(value, &imp->delay_ns);
+        } else if (strcmp(tok, "jitter") == 0) {
+            bad = parse_ms(value, &imp->jitter_ns);
+        } else if (strcmp(tok, "dist") == 0) {
+            if (strcmp(value, "uniform") == 0) {
+                imp->dist = DELAY_UNIFORM;
+            } else if (strcmp(value, "normal") == 0) {
+                imp->dist = DELAY_NORMAL;
+            } else {
+                fprintf(stderr, "Unknown delay distribution '%s'\n", value);
+                ret = -1;
+                break;
+            }
+        } else if (strcmp(tok, "loss") == 0) {
+            bad = parse_percent(value, &imp->loss);
+        } else if (strcmp(tok, "ge_p") == 0) {
+            bad = parse_percent(value, &imp->ge_p);
+        } else if (strcmp(tok, "ge_r") == 0) {
+            bad = parse_percent(value, &imp->ge_r);
+        } else if (strcmp(tok, "ge_bad_loss") == 0) {
+            bad = parse_percent(value, &imp->ge_bad_loss);
+        } else if (strcmp(tok, "ge_good_loss") == 0) {
+            bad = parse_percent(value, &imp->ge_good_loss);
+        } else if (strcmp(tok, "reorder") == 0) {
+            bad = parse_percent(value, &imp->reorder);
+        } else if (strcmp(tok, "dup") == 0) {
+            bad = parse_percent(value, &imp->duplicate);
+        } else if (strcmp(tok, "rate") == 0) {
+            bad = parse_rate(value, &imp->rate_bps);
+        } else if (strcmp(tok, "burst") == 0) {
+            bad = parse_count(value, &imp->burst_bytes);
+        } else if (strcmp(tok, "queue") == 0) {
+            bad = parse_ms(value, &imp->queue_ns);
+        } else if (strcmp(tok, "seed") == 0) {
+            bad = parse_count(value, &imp->seed);
+        } else {
+            fprintf(stderr, "Unknown impairment '%s'\n", tok);
+            ret = -1;
+            break;
+        }
+
+        if (bad) {
+            fprintf(stderr, "Bad %s '%s'\n", tok, value);
+            ret = -1;
+            break;
+        }
+    }
+
+    free(copy);
+    return ret;
+}
+
+
+// xorshift64*: cheap and reproducible for a given seed
+static inline double relay_random(Relay *r) {
+    r->rng ^= r->rng >> 12;
+    r->rng ^= r->rng << 25;
+    r->rng ^= r->rng >> 27;
+    return ((r->rng * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+}
+
+static double relay_gaussian(Relay *r) {
+    double u1 = relay_random(r), u2 = relay_random(r);
+    if (u1 < 1e-300)
+        u1 = 1e-300;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static uint64_t sample_delay(Relay *r) {
+    Impairment *imp = &r->imp;
+
+    if (imp->jitter_ns == 0)
+        return imp->delay_ns;
+
+    double offset;
+    if (imp->dist == DELAY_NORMAL)
+        offset = relay_gaussian(r) * imp->jitter_ns;
+    else
+        offset = (relay_random(r) * 2.0 - 1.0) * imp->jitter_ns;
+
+    double delay = imp->delay_ns + offset;
+    return delay > 0 ? (uint64_t)delay : 0;
+}
+
+// Returns 1 and counts the reason if this packet is lost.
+static int should_drop(Relay *r) {
+    Impairment *imp = &r->imp;
+
+    if (imp->loss > 0 && relay_random(r) < imp->loss) {
+        r->stats.lost_random++;
+        return 1;
+    }
+
+    if (imp->ge_p > 0) {
+        if (r->ge_bad) {
+            if (relay_random(r) < imp->ge_r)
+                r->ge_bad = 0;
+        } else if (relay_random(r) < imp->ge_p) {
+            r->ge_bad = 1;
+        }
+
+        double p = r->ge_bad ? imp->ge_bad_loss : imp->ge_good_loss;
+        if (p > 0 && relay_random(r) < p) {
+            r->stats.lost_burst++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Departure time once the token bucket admits the packet, or UINT64_MAX on tail drop.
+static uint64_t token_bucket_depart(Relay *r, uint32_t len, uint64_t now) {
+    uint64_t rate = r->imp.rate_bps;
+    uint64_t t = now > r->tb_last_ns ? now : r->tb_last_ns;
+
+    if (t > r->tb_last_ns) {
+        r->tb_credit += (unsigned __int128)(t - r->tb_last_ns) * rate;
+        if (r->tb_credit > r->tb_capacity)
+            r->tb_credit = r->tb_capacity;
+        r->tb_last_ns = t;
+    }
+
+    // charge the wire size, as the receiver's throughput figure does
+    unsigned __int128 cost = (unsigned __int128)(len + TOTAL_HEADER_SIZE) * 8 * NSEC_PER_SEC;
+    if (r->tb_credit >= cost) {
+        r->tb_credit -= cost;
+        return t;
+    }
+
+    uint64_t wait = (uint64_t)((cost - r->tb_credit + rate - 1) / rate);
+    if (t + wait - now > r->imp.queue_ns)
+        return UINT64_MAX;
+
+    r->tb_credit = r->tb_credit + (unsigned __int128)wait * rate - cost;
+    r->tb_last_ns = t + wait;
+    return t + wait;
+}
+
+
+static uint32_t pool_get(Relay *r) {
+    uint32_t idx = r->free_head;
+    if (idx != RELAY_NIL) {
+        r->free_head = r->pool[idx].next;
+        r->pending++;
+    }
+    return idx;
+}
+
+static void pool_put(Relay *r, uint32_t idx) {
+    r->pool[idx].next = r->free_head;
+    r->free_head = idx;
+    r->pending--;
+}
+
+static void wheel_insert(Relay *r, uint32_t idx) {
+    RelayPacket *pkt = &r->pool[idx];
+    uint64_t tick = pkt->due_ns / RELAY_TICK_NS;
+
+    if (tick < r->wheel_tick)
+        tick = r->wheel_tick;
+
+    WheelSlot *slot = &r->wheel[tick & (RELAY_WHEEL_SLOTS - 1)];
+    pkt->next = RELAY_NIL;
+    if (slot->tail == RELAY_NIL)
+        slot->head = idx;
+    else
+        r->pool[slot->tail].next = idx;
+    slot->tail = idx;
+}
+
+
+// Time at which wheel_advance will release the earliest queued packet, or 0 if none.
+static uint64_t wheel_next_wake(Relay *r) {
+    for (uint64_t t = r->wheel_tick; t < r->wheel_tick + RELAY_WHEEL_SLOTS; t++) {
+        if (r->wheel[t & (RELAY_WHEEL_SLOTS - 1)].head != RELAY_NIL)
+            return (t + 1) * RELAY_TICK_NS;
+    }
+    return 0;
+}
+
+// Arms timer_fd for the next due packet, at least one tick out; disarms it when idle.
+static void wheel_arm_timer(Relay *r, int timer_fd, uint64_t now) {
+    struct itimerspec its;
+    uint64_t wake = r->pending ? wheel_next_wake(r) : 0;
+
+    memset(&its, 0, sizeof(its));
+    if (wake) {
+        uint64_t wait = wake > now + RELAY_TICK_NS ? wake - now : RELAY_TICK_NS;
+        its.it_value.tv_sec = wait / NSEC_PER_SEC;
+        its.it_value.tv_nsec = wait % NSEC_PER_SEC;
+    }
+    timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+
+static void flush_batch(Relay *r, int c) {
+    SendBatch *b = &r->out[c];
+    int done = 0;
+
+    while (done < b->count) {
+        int n = sendmmsg(r->chan[c].upstream_fd, b->msgs + done, b->count - done, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            // e.g. ECONNREFUSED before the server binds: drop this packet, retry the rest
+            uint64_t now = now_ns();
+            if (now - r->last_send_error_ns >= NSEC_PER_SEC) {
+                perror("sendmmsg failed");
+                r->last_send_error_ns = now;
+            }
+            r->stats.lost_send++;
+            done++;
+            continue;
+        }
+        r->stats.forwarded += n;
+        done += n;
+    }
+
+    for (int i = 0; i < b->count; i++)
+        pool_put(r, b->idx[i]);
+    b->count = 0;
+}
+
+static void queue_send(Relay *r, uint32_t idx) {
+    RelayPacket *pkt = &r->pool[idx];
+    SendBatch *b = &r->out[pkt->channel];
+
+    b->iov[b->count].iov_base = pkt->data;
+    b->iov[b->count].iov_len = pkt->len;
+    b->idx[b->count] = idx;
+    b->count++;
+    if (b->count == RELAY_BATCH)
+        flush_batch(r, pkt->channel);
+}
+
+// Sends everything due in fully elapsed ticks; entries a full revolution ahead stay put.
+static void wheel_advance(Relay *r, uint64_t now) {
+    uint64_t now_tick = now / RELAY_TICK_NS;
+
+    if (r->pending == 0) {
+        r->wheel_tick = now_tick;
+        return;
+    }
+
+    uint64_t end = now_tick;
+    if (end - r->wheel_tick > RELAY_WHEEL_SLOTS)
+        end = r->wheel_tick + RELAY_WHEEL_SLOTS;
+
+    for (uint64_t t = r->wheel_tick; t < end; t++) {
+        WheelSlot *slot = &r->wheel[t & (RELAY_WHEEL_SLOTS - 1)];
+        uint32_t idx = slot->head;
+
+        slot->head = slot->tail = RELAY_NIL;
+        while (idx != RELAY_NIL) {
+            uint32_t next = r->pool[idx].next;
+            if (r->pool[idx].due_ns < now) {
+                queue_send(r, idx);
+            } else {
+                r->pool[idx].next = RELAY_NIL;
+                if (slot->tail == RELAY_NIL)
+                    slot->head = idx;
+                else
+                    r->pool[slot->tail].next = idx;
+                slot->tail = idx;
+            }
+            idx = next;
+        }
+    }
+    r->wheel_tick = now_tick;
+
+    for (int c = 0; c < RELAY_CHANNELS; c++) {
+        if (r->out[c].count)
+            flush_batch(r, c);
+    }
+}
+
+
+static void enqueue_packet(Relay *r, int c, const char *data, uint32_t len, uint64_t now) {
+    int copies = 1;
+
+    r->stats.received++;
+    if (should_drop(r))
+        return;
+
+    if (r->imp.duplicate > 0 && relay_random(r) < r->imp.duplicate) {
+        r->stats.duplicated++;
+        copies = 2;
+    }
+
+    for (int i = 0; i < copies; i++) {
+        uint64_t depart = now;
+        if (r->imp.rate_bps) {
+            depart = token_bucket_depart(r, len, now);
+            if (depart == UINT64_MAX) {
+                r->stats.lost_queue++;
+                continue;
+            }
+        }
+
+        if (r->imp.reorder > 0 && relay_random(r) < r->imp.reorder)
+            r->stats.reordered++;
+        else
+            depart += sample_delay(r);
+
+        uint32_t idx = pool_get(r);
+        if (idx == RELAY_NIL) {
+            r->stats.lost_pool++;
+            continue;
+        }
+
+        RelayPacket *pkt = &r->pool[idx];
+        if (pkt->cap < len) {
+            char *grown = realloc(pkt->data, len);
+            if (!grown) {
+                perror("memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            pkt->data = grown;
+            pkt->cap = len;
+        }
+        memcpy(pkt->data, data, len);
+        pkt->len = len;
+        pkt->due_ns = depart;
+        pkt->channel = c;
+        wheel_insert(r, idx);
+    }
+}
+
+static void handle_client_rx(Relay *r, int c, uint64_t now) {
+    RelayChannel *ch = &r->chan[c];
+
+    for (int i = 0; i < RELAY_BATCH; i++)
+        r->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+
+    int n = recvmmsg(ch->listen_fd, r->rx_msgs, RELAY_BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+        return;
+
+    ch->client_addr = r->rx_addr[n - 1];
+    ch->have_client = 1;
+
+    for (int i = 0; i < n; i++)
+        enqueue_packet(r, c, r->rx_iov[i].iov_base, r->rx_msgs[i].msg_len, now);
+}
+
+// Replies go straight back to the client.
+static void handle_upstream_rx(Relay *r, int c) {
+    RelayChannel *ch = &r->chan[c];
+    struct mmsghdr tx[RELAY_BATCH];
+    struct iovec iov[RELAY_BATCH];
+
+    int n = recvmmsg(ch->upstream_fd, r->rx_msgs, RELAY_BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0 || !ch->have_client)
+        return;
+
+    memset(tx, 0, n * sizeof(tx[0]));
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = r->rx_iov[i].iov_base;
+        iov[i].iov_len = r->rx_msgs[i].msg_len;
+        tx[i].msg_hdr.msg_iov = &iov[i];
+        tx[i].msg_hdr.msg_iovlen = 1;
+        tx[i].msg_hdr.msg_name = &ch->client_addr;
+        tx[i].msg_hdr.msg_namelen = sizeof(ch->client_addr);
+    }
+
+    int sent = sendmmsg(ch->listen_fd, tx, n, 0);
+    if (sent > 0)
+        r->stats.returned += sent;
+}
+
+
+static int udp_socket_bound(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    int bufsize = RELAY_SOCKBUF;
+
+    if (fd < 0) {
+        perror("socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind failed");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static int udp_socket_connected(const char *ip, int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    int bufsize = RELAY_SOCKBUF;
+
+    if (fd < 0) {
+        perror("socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0) {
+        perror("invalid address");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect failed");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+
+typedef struct {
+    const char *upstream_ip;
+    int listen_port;
+    int upstream_port;
+} ControlProxyArgs;
+
+static void pipe_connection(int a, int b) {
+    struct pollfd fds[2] = { { a, POLLIN, 0 }, { b, POLLIN, 0 } };
+    char buf[4096];
+
+    while (poll(fds, 2, -1) > 0) {
+        for (int i = 0; i < 2; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ssize_t n = recv(fds[i].fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return;
+            if (send(fds[1 - i].fd, buf, n, 0) < 0)
+                return;
+        }
+    }
+}
+
+// The TCP config exchange is passed through untouched, one connection at a time.
+static void *control_proxy(void *arg) {
+    ControlProxyArgs *args = arg;
+    struct sockaddr_in addr, upstream;
+    int server_fd, opt = 1;
+
+    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        perror("Socket failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(args->listen_port);
+    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server_fd, 1) < 0) {
+        perror("Control proxy bind/listen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&upstream, 0, sizeof(upstream));
+    upstream.sin_family = AF_INET;
+    upstream.sin_port = htons(args->upstream_port);
+    inet_pton(AF_INET, args->upstream_ip, &upstream.sin_addr);
+
+    while (1) {
+        int client_sock = accept(server_fd, NULL, NULL);
+        if (client_sock < 0)
+            continue;
+
+        int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (server_sock >= 0 &&
+            connect(server_sock, (struct sockaddr *)&upstream, sizeof(upstream)) == 0) {
+            printf("Control connection relayed\n");
+            pipe_connection(client_sock, server_sock);
+        } else {
+            perror("Control proxy connect failed");
+        }
+
+        if (server_sock >= 0)
+            close(server_sock);
+        close(client_sock);
+    }
+    return NULL;
+}
+
+
+static void print_relay_stats(const char *label, RelayStats *s) {
+    printf("%s rx %lu  fwd %lu  ret %lu  lost %lu (random %lu, burst %lu, queue %lu, pool %lu, send %lu)  dup %lu  reord %lu\n",
+           label, s->received, s->forwarded, s->returned,
+           s->lost_random + s->lost_burst + s->lost_queue + s->lost_pool + s->lost_send,
+           s->lost_random, s->lost_burst, s->lost_queue, s->lost_pool, s->lost_send,
+           s->duplicated, s->reordered);
+}
+
+static void print_impairment(Impairment *imp) {
+    printf("Delay:                  %.3f ms +/- %.3f ms (%s)\n",
+           imp->delay_ns / 1e6, imp->jitter_ns / 1e6,
+           imp->dist == DELAY_NORMAL ? "normal" : "uniform");
+    printf("Random loss:            %.3f%%\n", imp->loss * 100);
+    if (imp->ge_p > 0)
+        printf("Gilbert-Elliott:        p %.3f%%  r %.3f%%  bad loss %.1f%%  good loss %.1f%%\n",
+               imp->ge_p * 100, imp->ge_r * 100, imp->ge_bad_loss * 100, imp->ge_good_loss * 100);
+    printf("Reorder / duplicate:    %.3f%% / %.3f%%\n", imp->reorder * 100, imp->duplicate * 100);
+    if (imp->rate_bps)
+        printf("Rate limit:             %.3f Mbps, burst %lu bytes, queue %.1f ms\n",
+               imp->rate_bps / 1e6, imp->burst_bytes, imp->queue_ns / 1e6);
+    printf("Seed:                   %lu\n\n", imp->seed);
+}
+
+void udp_relay(const char *upstream_ip, int listen_port, int upstream_port, const char *spec) {
+    Relay *r = calloc(1, sizeof(Relay));
+    ControlProxyArgs proxy_args = { upstream_ip, listen_port, upstream_port };
+    pthread_t proxy_tid;
+    struct epoll_event ev, events[2 * RELAY_CHANNELS + 1];
+    int epfd, timer_fd;
+
+    if (!r || parse_impairment(spec, &r->imp) < 0) {
+        fprintf(stderr, "Error: invalid impairment spec\n");
+        exit(EXIT_FAILURE);
+    }
+
+    r->rng = r->imp.seed ? r->imp.seed : 1;
+    r->tb_capacity = (unsigned __int128)r->imp.burst_bytes * 8 * NSEC_PER_SEC;
+    r->tb_credit = r->tb_capacity;
+
+    r->pool = calloc(RELAY_POOL_SIZE, sizeof(RelayPacket));
+    r->wheel = malloc(RELAY_WHEEL_SLOTS * sizeof(WheelSlot));
+    r->rx_arena = malloc((size_t)RELAY_BATCH * RELAY_MAX_DGRAM);
+    if (!r->pool || !r->wheel || !r->rx_arena) {
+        perror("memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < RELAY_POOL_SIZE; i++)
+        r->pool[i].next = i + 1 < RELAY_POOL_SIZE ? i + 1 : RELAY_NIL;
+    r->free_head = 0;
+    for (uint32_t i = 0; i < RELAY_WHEEL_SLOTS; i++)
+        r->wheel[i].head = r->wheel[i].tail = RELAY_NIL;
+
+    for (int i = 0; i < RELAY_BATCH; i++) {
+        r->rx_iov[i].iov_base = r->rx_arena + (size_t)i * RELAY_MAX_DGRAM;
+        r->rx_iov[i].iov_len = RELAY_MAX_DGRAM;
+        r->rx_msgs[i].msg_hdr.msg_iov = &r->rx_iov[i];
+        r->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        r->rx_msgs[i].msg_hdr.msg_name = &r->rx_addr[i];
+        r->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    for (int c = 0; c < RELAY_CHANNELS; c++) {
+        for (int i = 0; i < RELAY_BATCH; i++) {
+            r->out[c].msgs[i].msg_hdr.msg_iov = &r->out[c].iov[i];
+            r->out[c].msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1 failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int c = 0; c < RELAY_CHANNELS; c++) {
+        int offset = c ? PROBE_PORT_OFFSET : 0;
+        r->chan[c].listen_fd = udp_socket_bound(listen_port + offset);
+        r->chan[c].upstream_fd = udp_socket_connected(upstream_ip, upstream_port + offset);
+
+        ev.events = EPOLLIN;
+        ev.data.u32 = c * 2;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, r->chan[c].listen_fd, &ev);
+        ev.data.u32 = c * 2 + 1;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, r->chan[c].upstream_fd, &ev);
+    }
+
+    // wakes the loop when the next delayed packet is due instead of spinning
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timer_fd < 0) {
+        perror("timerfd_create failed");
+        exit(EXIT_FAILURE);
+    }
+    ev.events = EPOLLIN;
+    ev.data.u32 = RELAY_TIMER_EVENT;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timer_fd, &ev);
+
+    if (pthread_create(&proxy_tid, NULL, control_proxy, &proxy_args) != 0) {
+        perror("pthread_create failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(proxy_tid);
+
+    signal(SIGINT, relay_signal);
+    signal(SIGTERM, relay_signal);
+
+    printf("Relaying port %d -> %s:%d (probes %d -> %d)\n", listen_port, upstream_ip,
+           upstream_port, listen_port + PROBE_PORT_OFFSET, upstream_port + PROBE_PORT_OFFSET);
+    print_impairment(&r->imp);
+
+    uint64_t start_ns = now_ns();
+    uint64_t next_report = start_ns + NSEC_PER_SEC;
+    RelayStats prev = {0};
+    int interval = 0;
+
+    r->wheel_tick = start_ns / RELAY_TICK_NS;
+
+    while (!relay_stop) {
+        int n = epoll_wait(epfd, events, 2 * RELAY_CHANNELS + 1, 100);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait failed");
+            break;
+        }
+
+        uint64_t now = now_ns();
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 == RELAY_TIMER_EVENT) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                    perror("timerfd read failed");
+                continue;
+            }
+            int c = events[i].data.u32 / 2;
+            if (events[i].data.u32 & 1)
+                handle_upstream_rx(r, c);
+            else
+                handle_client_rx(r, c, now);
+        }
+
+        now = now_ns();
+        wheel_advance(r, now);
+        wheel_arm_timer(r, timer_fd, now);
+
+        if (now >= next_report) {
+            if (r->stats.received != prev.received) {
+                RelayStats delta = r->stats;
+                char label[32];
+
+                delta.received -= prev.received;
+                delta.forwarded -= prev.forwarded;
+                delta.returned -= prev.returned;
+                delta.lost_random -= prev.lost_random;
+                delta.lost_burst -= prev.lost_burst;
+                delta.lost_queue -= prev.lost_queue;
+                delta.lost_pool -= prev.lost_pool;
+                delta.lost_send -= prev.lost_send;
+                delta.duplicated -= prev.duplicated;
+                delta.reordered -= prev.reordered;
+
+                snprintf(label, sizeof(label), "[%4d-%4d s]", interval, interval + 1);
+                print_relay_stats(label, &delta);
+                fflush(stdout);
+                prev = r->stats;
+            }
+            interval++;
+            next_report += NSEC_PER_SEC;
+        }
+    }
+
+    printf("\n=== Relay Summary ===\n");
+    print_relay_stats("Total:", &r->stats);
+
+    for (int c = 0; c < RELAY_CHANNELS; c++) {
+        close(r->chan[c].listen_fd);
+        close(r->chan[c].upstream_fd);
+    }
+    close(timer_fd);
+    close(epfd);
+    for (uint32_t i = 0; i < RELAY_POOL_SIZE; i++)
+        free(r->pool[i].data);
+    free(r->pool);
+    free(r->wheel);
+    free(r->rx_arena);
+    free(r);
+}
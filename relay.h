@@ -0,0 +1,38 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stdint.h>
+
+#define RELAY_CHANNELS 2  // bulk data on the UDP port, latency probes on port + PROBE_PORT_OFFSET
+
+typedef enum {
+    DELAY_UNIFORM = 0,  // delay +/- jitter, uniformly distributed
+    DELAY_NORMAL        // mean delay, jitter as standard deviation
+} DelayDist;
+
+// Impairments applied to client->server traffic. Probabilities are 0..1.
+typedef struct {
+    uint64_t delay_ns;
+    uint64_t jitter_ns;
+    DelayDist dist;
+    double loss;            // independent random loss
+    double ge_p;            // Gilbert-Elliott: P(good -> bad), 0 disables the model
+    double ge_r;            // Gilbert-Elliott: P(bad -> good)
+    double ge_bad_loss;     // loss probability in the bad state
+    double ge_good_loss;    // loss probability in the good state
+    double reorder;         // packets sent without delay, overtaking queued ones
+    double duplicate;
+    uint64_t rate_bps;      // token bucket rate, 0 = unlimited
+    uint64_t burst_bytes;   // token bucket depth
+    uint64_t queue_ns;      // max time a packet may wait for tokens before tail drop
+    uint64_t seed;
+} Impairment;
+
+// Parses "key=value,key=value,...". Returns 0 on success, -1 on a bad spec.
+int parse_impairment(const char *spec, Impairment *imp);
+
+// Forwards TCP control and UDP traffic from listen_port to upstream_ip:upstream_port,
+// impairing the client->server direction. Runs until SIGINT/SIGTERM.
+void udp_relay(const char *upstream_ip, int listen_port, int upstream_port, const char *spec);
+
+#endif
@@ -18,6 +18,9 @@
 #define MAX_CLIENTS 10 // Max concurrent clients
 #define PORT 8080
 #define PORT_UDP 8081 
+#define PROBE_PORT_OFFSET 1 // latency probes use the UDP port + this
+#define STREAM_PORT(base, k) ((k) == 0 ? (base) : (base) + PROBE_PORT_OFFSET + (k))  // skips the probe port
+#define FIRST_PACKET_TIMEOUT_SEC 30
 
 #define ETHERNET_HEADER_SIZE 14   // Ethernet header (without VLAN)
 #define IP_HEADER_SIZE 20         // IPv4 header (without options)
@@ -28,22 +31,59 @@
 #define DEFAULT_NUM_PACKETS 1000
 #define DEFAULT_PORT 5000
 
+// control message types
+#define MSG_CONFIG 1
+#define MSG_CASE 2      // scenario case, payload is a Config
+#define MSG_RESULT 3    // scenario case result, payload is a CaseReport
+#define MSG_DONE 4      // end of scenario session
+
 
 typedef struct {
     int is_server;
     int is_client;
+    int is_relay;
     char *address;
     int port;
     int interval;
     char *filename;
     int udp_packet_size;
-    int bandwidth;
+    uint64_t bandwidth;
     int num_streams;
     int duration;
     int measure_delay;
     int wait_time;
+    int clock_bench;
+    int latency_under_load;
+    int probe_timeout_ms;   // -L: probes unanswered this long count as lost
+    int upstream_port;
+    char *impairment;
+    int rtt_us;         // measured by the client during the control handshake
+    int offload;        // UDP GSO on the sender, UDP GRO on the receiver
+    char *scenario_file;
+    int scenario;       // keep the control connection open for a run of cases
+    int direction;      // 0: client sends, 1: server sends
+    int warmup;         // seconds of unmeasured traffic before each case
 } Config;
 
+// Totals of one sender or receiver run.
+typedef struct {
+    uint64_t packets;
+    uint64_t payload_bytes;
+    uint64_t transmitted_bytes;
+    uint64_t lost;
+    uint64_t out_of_order;
+    uint64_t socket_drops;
+    uint64_t backpressure;
+    double elapsed_sec;
+    double jitter_us;
+} TestResult;
+
+typedef struct {
+    TestResult result;
+    double cpu_user_sec;
+    double cpu_sys_sec;
+} CaseReport;
+
 typedef struct {
     uint16_t msg_type;  
     uint16_t msg_length; 
@@ -0,0 +1,475 @@
+#include "scenario.h"
+#include "client.h"
+#include "server.h"
+#include "timing.h"
+#include "netstats.h"
+#include "control.h"
+
+#include <ctype.h>
+#include <sys/resource.h>
+
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+// Splits a comma separated list; returns the number of values or -1 on a bad value.
+static int parse_list(char *list, const char *path, int lineno, const char *key, void *out, int is_rate) {
+    char *saveptr = NULL;
+    int n = 0;
+
+    for (char *tok = strtok_r(list, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        tok = trim(tok);
+        if (!*tok)
+            continue;
+        if (n == SCENARIO_MAX_VALUES) {
+            fprintf(stderr, "%s:%d: too many values for '%s' (max %d)\n", path, lineno, key, SCENARIO_MAX_VALUES);
+            return -1;
+        }
+
+        if (is_rate) {
+            if (parse_rate(tok, &((uint64_t *)out)[n]) < 0 || ((uint64_t *)out)[n] == 0) {
+                fprintf(stderr, "%s:%d: bad rate '%s' (bps > 0, optional k/M/G suffix)\n", path, lineno, tok);
+                return -1;
+            }
+        } else if (strcmp(key, "direction") == 0) {
+            if (strcmp(tok, "up") == 0) {
+                ((int *)out)[n] = 0;
+            } else if (strcmp(tok, "down") == 0) {
+                ((int *)out)[n] = 1;
+            } else {
+                fprintf(stderr, "%s:%d: unknown direction '%s' (up or down)\n", path, lineno, tok);
+                return -1;
+            }
+        } else {
+            int v = atoi(tok);
+            if (strcmp(key, "size") == 0 && (v < (int)sizeof(uint32_t) || v > UDP_MAX_PAYLOAD)) {
+                fprintf(stderr, "%s:%d: bad size '%s' (%d to %d bytes)\n",
+                        path, lineno, tok, (int)sizeof(uint32_t), UDP_MAX_PAYLOAD);
+                return -1;
+            }
+            if (strcmp(key, "streams") == 0 && v < 1) {
+                fprintf(stderr, "%s:%d: bad stream count '%s'\n", path, lineno, tok);
+                return -1;
+            }
+            ((int *)out)[n] = v;
+        }
+        n++;
+    }
+    return n;
+}
+
+int parse_scenario_matrix(const char *path, ScenarioMatrix *matrix) {
+    FILE *f = fopen(path, "r");
+    char line[1024];
+    int lineno = 0;
+
+    if (!f) {
+        perror("Failed to open scenario file");
+        return -1;
+    }
+
+    memset(matrix, 0, sizeof(*matrix));
+    matrix->duration = 10;
+    matrix->warmup = 1;
+    matrix->cooldown = 1;
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char *key = trim(line);
+        if (!*key)
+            continue;
+
+        char *value = strchr(key, '=');
+        if (!value) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+        *value++ = '\0';
+        key = trim(key);
+        value = trim(value);
+
+        int n = 0;
+        if (strcmp(key, "size") == 0) {
+            n = matrix->n_sizes = parse_list(value, path, lineno, key, matrix->sizes, 0);
+        } else if (strcmp(key, "rate") == 0) {
+            n = matrix->n_rates = parse_list(value, path, lineno, key, matrix->rates, 1);
+        } else if (strcmp(key, "streams") == 0) {
+            n = matrix->n_streams = parse_list(value, path, lineno, key, matrix->streams, 0);
+        } else if (strcmp(key, "direction") == 0) {
+            n = matrix->n_directions = parse_list(value, path, lineno, key, matrix->directions, 0);
+        } else if (strcmp(key, "offload") == 0) {
+            n = matrix->n_offloads = parse_list(value, path, lineno, key, matrix->offloads, 0);
+        } else if (strcmp(key, "duration") == 0) {
+            matrix->duration = atoi(value);
+        } else if (strcmp(key, "warmup") == 0) {
+            matrix->warmup = atoi(value);
+        } else if (strcmp(key, "cooldown") == 0) {
+            matrix->cooldown = atoi(value);
+        } else {
+            fprintf(stderr, "%s:%d: unknown key '%s'\n", path, lineno, key);
+            fclose(f);
+            return -1;
+        }
+
+        if (matrix->warmup < 0 || matrix->cooldown < 0) {
+            fprintf(stderr, "%s:%d: %s must not be negative\n", path, lineno, key);
+            n = -1;
+        }
+        if (n < 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+
+    // unset axes take the single-run defaults
+    if (!matrix->n_sizes) { matrix->sizes[0] = 1024; matrix->n_sizes = 1; }
+    if (!matrix->n_rates) { matrix->rates[0] = 1000000; matrix->n_rates = 1; }
+    if (!matrix->n_streams) { matrix->streams[0] = 1; matrix->n_streams = 1; }
+    if (!matrix->n_directions) { matrix->directions[0] = 0; matrix->n_directions = 1; }
+    if (!matrix->n_offloads) { matrix->offloads[0] = 0; matrix->n_offloads = 1; }
+
+    if (matrix->duration <= 0) {
+        fprintf(stderr, "%s: duration must be positive\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+
+typedef struct {
+    int sending;
+    const char *peer_ip;
+    int port;
+    const Config *c;
+    uint64_t rate_bps;
+    uint64_t rtt_ns;
+    volatile uint64_t progress;
+    TestResult result;
+} StreamJob;
+
+static void *stream_thread(void *arg) {
+    StreamJob *job = arg;
+    const Config *c = job->c;
+
+    if (job->sending) {
+        udp_sender(job->peer_ip, job->port, c->udp_packet_size, job->rate_bps,
+                   c->warmup + c->duration + SCENARIO_TAIL_SEC, job->rtt_ns, c->offload,
+                   &job->progress, &job->result);
+    } else {
+        udp_receiver(job->port, c->udp_packet_size, c->duration, job->rate_bps,
+                     job->rtt_ns, c->offload, c->warmup, &job->result);
+    }
+    return NULL;
+}
+
+void run_streams(int sending, const char *peer_ip, int base_port, const Config *c,
+    uint64_t rtt_ns, TestResult *total) {
+    int n = c->num_streams > 0 ? c->num_streams : 1;
+    StreamJob *jobs = calloc(n, sizeof(StreamJob));
+    pthread_t *tids = calloc(n, sizeof(pthread_t));
+    double jitter_weighted = 0.0;
+
+    if (!jobs || !tids) {
+        perror("memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int k = 0; k < n; k++) {
+        jobs[k].sending = sending;
+        jobs[k].peer_ip = peer_ip;
+        jobs[k].port = STREAM_PORT(base_port, k);
+        jobs[k].c = c;
+        jobs[k].rate_bps = c->bandwidth / n;
+        jobs[k].rtt_ns = rtt_ns;
+        if (pthread_create(&tids[k], NULL, stream_thread, &jobs[k]) != 0) {
+            perror("pthread_create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memset(total, 0, sizeof(*total));
+    for (int k = 0; k < n; k++) {
+        TestResult *r = &jobs[k].result;
+
+        pthread_join(tids[k], NULL);
+        total->packets += r->packets;
+        total->payload_bytes += r->payload_bytes;
+        total->transmitted_bytes += r->transmitted_bytes;
+        total->lost += r->lost;
+        total->out_of_order += r->out_of_order;
+        total->socket_drops += r->socket_drops;
+        total->backpressure += r->backpressure;
+        if (r->elapsed_sec > total->elapsed_sec)
+            total->elapsed_sec = r->elapsed_sec;
+        jitter_weighted += r->jitter_us * r->packets;
+    }
+    if (total->packets)
+        total->jitter_us = jitter_weighted / total->packets;
+
+    free(jobs);
+    free(tids);
+}
+
+
+static double timeval_sec(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void cpu_delta(const struct rusage *before, const struct rusage *after,
+    double *user_sec, double *sys_sec) {
+    *user_sec = timeval_sec(after->ru_utime) - timeval_sec(before->ru_utime);
+    *sys_sec = timeval_sec(after->ru_stime) - timeval_sec(before->ru_stime);
+}
+
+
+#define RECORD_FIELDS 26
+
+// rx_* and lost cover the measured window only; tx_* cover the sender's whole run,
+// warm-up and tail included, so tx_packets_total - rx_packets is not a loss count.
+static const char *record_names[RECORD_FIELDS] = {
+    "case", "size", "rate_bps", "streams", "direction", "offload", "duration_s", "warmup_s",
+    "start_time", "wall_s",
+    "rx_packets", "rx_payload_bytes", "lost", "loss_pct", "out_of_order", "socket_drops",
+    "goodput_mbps", "throughput_mbps", "jitter_us",
+    "tx_packets_total", "tx_mbps", "backpressure",
+    "client_cpu_user_s", "client_cpu_sys_s", "server_cpu_user_s", "server_cpu_sys_s"
+};
+
+static void write_csv_header(FILE *out) {
+    for (int i = 0; i < RECORD_FIELDS; i++)
+        fprintf(out, "%s%s", record_names[i], i + 1 < RECORD_FIELDS ? "," : "\n");
+}
+
+// One line per case; rx/tx are the receiving and sending side whichever host they ran on.
+static void write_record(FILE *out, int csv, int index, const Config *c,
+    double start_time, double wall_sec, const TestResult *rx, const TestResult *tx,
+    const double client_cpu[2], const double server_cpu[2]) {
+    char values[RECORD_FIELDS][48];
+    const char *direction = c->direction ? "down" : "up";
+    uint64_t offered = rx->packets + rx->lost;
+    int i = 0;
+
+    snprintf(values[i++], 48, "%d", index);
+    snprintf(values[i++], 48, "%d", c->udp_packet_size);
+    snprintf(values[i++], 48, "%lu", c->bandwidth);
+    snprintf(values[i++], 48, "%d", c->num_streams);
+    snprintf(values[i++], 48, csv ? "%s" : "\"%s\"", direction);
+    snprintf(values[i++], 48, "%d", c->offload);
+    snprintf(values[i++], 48, "%d", c->duration);
+    snprintf(values[i++], 48, "%d", c->warmup);
+    snprintf(values[i++], 48, "%.3f", start_time);
+    snprintf(values[i++], 48, "%.3f", wall_sec);
+    snprintf(values[i++], 48, "%lu", rx->packets);
+    snprintf(values[i++], 48, "%lu", rx->payload_bytes);
+    snprintf(values[i++], 48, "%lu", rx->lost);
+    snprintf(values[i++], 48, "%.4f", offered ? rx->lost * 100.0 / offered : 0.0);
+    snprintf(values[i++], 48, "%lu", rx->out_of_order);
+    snprintf(values[i++], 48, "%lu", rx->socket_drops);
+    snprintf(values[i++], 48, "%.3f", rx->elapsed_sec > 0 ? rx->payload_bytes * 8.0 / (rx->elapsed_sec * 1e6) : 0.0);
+    snprintf(values[i++], 48, "%.3f", rx->elapsed_sec > 0 ? rx->transmitted_bytes * 8.0 / (rx->elapsed_sec * 1e6) : 0.0);
+    snprintf(values[i++], 48, "%.3f", rx->jitter_us);
+    snprintf(values[i++], 48, "%lu", tx->packets);
+    snprintf(values[i++], 48, "%.3f", tx->elapsed_sec > 0 ? tx->transmitted_bytes * 8.0 / (tx->elapsed_sec * 1e6) : 0.0);
+    snprintf(values[i++], 48, "%lu", tx->backpressure);
+    snprintf(values[i++], 48, "%.3f", client_cpu[0]);
+    snprintf(values[i++], 48, "%.3f", client_cpu[1]);
+    snprintf(values[i++], 48, "%.3f", server_cpu[0]);
+    snprintf(values[i++], 48, "%.3f", server_cpu[1]);
+
+    for (i = 0; i < RECORD_FIELDS; i++) {
+        if (csv)
+            fprintf(out, "%s%s", values[i], i + 1 < RECORD_FIELDS ? "," : "\n");
+        else
+            fprintf(out, "%s\"%s\": %s%s", i ? "" : "{", record_names[i], values[i],
+                    i + 1 < RECORD_FIELDS ? ", " : "}\n");
+    }
+    fflush(out);
+}
+
+
+static int connect_control(const char *server_ip, int port, uint64_t *rtt_ns) {
+    struct sockaddr_in server_addr;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sock < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
+        perror("invalid address");
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t t0 = now_ns();
+    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Connection failed");
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+    *rtt_ns = now_ns() - t0;
+    return sock;
+}
+
+void run_scenario(const char *server_ip, int control_port, int udp_port,
+    const char *matrix_path, const char *output_path) {
+    ScenarioMatrix m;
+    Config session = {0};
+    uint64_t rtt_ns;
+
+    if (parse_scenario_matrix(matrix_path, &m) < 0)
+        exit(EXIT_FAILURE);
+
+    int total_cases = m.n_sizes * m.n_rates * m.n_streams * m.n_directions * m.n_offloads;
+    size_t path_len = strlen(output_path);
+    int csv = path_len >= 4 && strcmp(output_path + path_len - 4, ".csv") == 0;
+
+    FILE *out = fopen(output_path, "w");
+    if (!out) {
+        perror("Failed to open results file");
+        exit(EXIT_FAILURE);
+    }
+    if (csv)
+        write_csv_header(out);
+
+    int sock = connect_control(server_ip, control_port, &rtt_ns);
+    printf("Connected to server (RTT %.3f ms). Running %d cases, results in %s\n",
+           rtt_ns / 1e6, total_cases, output_path);
+
+    session.is_client = 1;
+    session.scenario = 1;
+    session.rtt_us = (int)(rtt_ns / NSEC_PER_USEC);
+    if (send_message(sock, MSG_CONFIG, &session, sizeof(session)) < 0) {
+        perror("Failed to send config");
+        exit(EXIT_FAILURE);
+    }
+
+    int index = 0;
+    for (int a = 0; a < m.n_sizes; a++)
+    for (int b = 0; b < m.n_rates; b++)
+    for (int s = 0; s < m.n_streams; s++)
+    for (int d = 0; d < m.n_directions; d++)
+    for (int o = 0; o < m.n_offloads; o++) {
+        Config c = session;
+        TestResult local, *rx, *tx;
+        CaseReport remote;
+        struct rusage ru_before, ru_after;
+        struct timeval start_tv;
+        double client_cpu[2], server_cpu[2];
+        uint16_t type;
+
+        c.udp_packet_size = m.sizes[a];
+        c.bandwidth = m.rates[b];
+        c.num_streams = m.streams[s];
+        c.direction = m.directions[d];
+        c.offload = m.offloads[o];
+        c.duration = m.duration;
+        c.warmup = m.warmup;
+
+        index++;
+        printf("\n=== Case %d/%d: size %d, rate %.3f Mbps, streams %d, %s%s ===\n",
+               index, total_cases, c.udp_packet_size, c.bandwidth / 1e6, c.num_streams,
+               c.direction ? "down" : "up", c.offload ? ", offload" : "");
+
+        gettimeofday(&start_tv, NULL);
+        getrusage(RUSAGE_SELF, &ru_before);
+        uint64_t t0 = now_ns();
+
+        if (send_message(sock, MSG_CASE, &c, sizeof(c)) < 0) {
+            perror("Failed to send case");
+            exit(EXIT_FAILURE);
+        }
+
+        run_streams(c.direction == 0, server_ip, udp_port, &c, rtt_ns, &local);
+
+        if (recv_message(sock, &type, &remote, sizeof(remote)) != sizeof(remote) || type != MSG_RESULT) {
+            fprintf(stderr, "Lost the control connection during case %d\n", index);
+            exit(EXIT_FAILURE);
+        }
+
+        double wall_sec = ns_to_sec(now_ns() - t0);
+        getrusage(RUSAGE_SELF, &ru_after);
+        cpu_delta(&ru_before, &ru_after, &client_cpu[0], &client_cpu[1]);
+        server_cpu[0] = remote.cpu_user_sec;
+        server_cpu[1] = remote.cpu_sys_sec;
+
+        rx = c.direction ? &local : &remote.result;
+        tx = c.direction ? &remote.result : &local;
+        write_record(out, csv, index, &c, timeval_sec(start_tv), wall_sec, rx, tx,
+                     client_cpu, server_cpu);
+
+        if (index < total_cases && m.cooldown > 0)
+            sleep(m.cooldown);
+    }
+
+    send_message(sock, MSG_DONE, NULL, 0);
+    close(sock);
+    fclose(out);
+    printf("\nScenario complete: %d cases written to %s\n", index, output_path);
+}
+
+
+void scenario_server(int control_sock, const struct sockaddr_in *peer, int udp_port) {
+    char peer_ip[INET_ADDRSTRLEN];
+    int cases = 0;
+
+    inet_ntop(AF_INET, &peer->sin_addr, peer_ip, sizeof(peer_ip));
+    printf("Scenario session with %s\n", peer_ip);
+
+    while (1) {
+        Config c;
+        CaseReport report;
+        struct rusage ru_before, ru_after;
+        uint16_t type;
+
+        int len = recv_message(control_sock, &type, &c, sizeof(c));
+        if (len < 0 || type == MSG_DONE)
+            break;
+        if (type != MSG_CASE || len != sizeof(c)) {
+            fprintf(stderr, "Unexpected control message %u\n", type);
+            break;
+        }
+
+        // pointers are meaningless on this side of the wire
+        c.address = NULL;
+        c.filename = NULL;
+        c.impairment = NULL;
+        c.scenario_file = NULL;
+
+        printf("\n=== Case %d: size %d, rate %.3f Mbps, streams %d, %s ===\n",
+               cases + 1, c.udp_packet_size, c.bandwidth / 1e6, c.num_streams,
+               c.direction ? "down" : "up");
+
+        memset(&report, 0, sizeof(report));
+        getrusage(RUSAGE_SELF, &ru_before);
+        run_streams(c.direction == 1, peer_ip, udp_port, &c,
+                    (uint64_t)c.rtt_us * NSEC_PER_USEC, &report.result);
+        getrusage(RUSAGE_SELF, &ru_after);
+        cpu_delta(&ru_before, &ru_after, &report.cpu_user_sec, &report.cpu_sys_sec);
+
+        if (send_message(control_sock, MSG_RESULT, &report, sizeof(report)) < 0) {
+            perror("Failed to send case result");
+            break;
+        }
+        cases++;
+    }
+
+    printf("Scenario session finished after %d cases\n", cases);
+    close(control_sock);
+}
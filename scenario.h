@@ -0,0 +1,54 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdint.h>
+#include "requirements.h"
+
+#define SCENARIO_MAX_VALUES 32
+#define UDP_MAX_PAYLOAD 65507        // 65535 - IP header - UDP header
+#define SCENARIO_TAIL_SEC 1          // sender keeps going past the measured window
+#define SCENARIO_DEFAULT_OUTPUT "scenario_results.ndjson"
+
+// Test matrix; every combination of the list-valued keys is one case. File format:
+//   size = 64, 512, 1400        # payload bytes
+//   rate = 100M, 1G             # bps, k/M/G suffixes allowed
+//   streams = 1, 4
+//   direction = up, down        # up: client sends
+//   offload = 0, 1              # UDP GSO/GRO
+//   duration = 10               # measured seconds per case
+//   warmup = 1                  # unmeasured seconds before each case
+//   cooldown = 1                # idle seconds between cases
+typedef struct {
+    int sizes[SCENARIO_MAX_VALUES];
+    int n_sizes;
+    uint64_t rates[SCENARIO_MAX_VALUES];
+    int n_rates;
+    int streams[SCENARIO_MAX_VALUES];
+    int n_streams;
+    int directions[SCENARIO_MAX_VALUES];
+    int n_directions;
+    int offloads[SCENARIO_MAX_VALUES];
+    int n_offloads;
+    int duration;
+    int warmup;
+    int cooldown;
+} ScenarioMatrix;
+
+// Reads "key = v1, v2, ..." lines. Returns 0 on success, -1 on error.
+int parse_scenario_matrix(const char *path, ScenarioMatrix *matrix);
+
+// Runs num_streams senders or receivers for one case and sums their results.
+void run_streams(int sending, const char *peer_ip, int base_port, const Config *c,
+    uint64_t rtt_ns, TestResult *total);
+
+// Client side: runs every case over one control connection and writes one record
+// per case to output_path (CSV if it ends in .csv, NDJSON otherwise). Loss is taken
+// from sequence gaps in the measured window (lost, loss_pct); tx_packets_total also
+// counts the warm-up and the SCENARIO_TAIL_SEC tail.
+void run_scenario(const char *server_ip, int control_port, int udp_port,
+    const char *matrix_path, const char *output_path);
+
+// Server side: serves cases on an open control connection until MSG_DONE.
+void scenario_server(int control_sock, const struct sockaddr_in *peer, int udp_port);
+
+#endif
@@ -1,8 +1,57 @@
 #include "server.h"
 #include "requirements.h"
+#include "timing.h"
+#include "netstats.h"
+#include "offload.h"
+#include "control.h"
 
 
-Config* start_tcp_server(int port, Config *received_config) {
+static int seq_window_test(const SeqWindow *w, uint32_t seq) {
+    return (w->bits[(seq % SEQ_WINDOW) / 64] >> (seq % 64)) & 1;
+}
+
+static void seq_window_set(SeqWindow *w, uint32_t seq) {
+    w->bits[(seq % SEQ_WINDOW) / 64] |= 1ULL << (seq % 64);
+}
+
+static void seq_window_clear(SeqWindow *w, uint32_t seq) {
+    w->bits[(seq % SEQ_WINDOW) / 64] &= ~(1ULL << (seq % 64));
+}
+
+// Everything before expected_seq counts as received; gaps are opened as they are seen.
+static void seq_window_init(SeqWindow *w, uint32_t expected_seq) {
+    memset(w->bits, 0xff, sizeof(w->bits));
+    w->base = expected_seq;
+}
+
+// Marks [from, to) as outstanding.
+static void seq_window_open_gap(SeqWindow *w, uint32_t from, uint32_t to) {
+    if (to - from >= SEQ_WINDOW) {
+        memset(w->bits, 0, sizeof(w->bits));
+        return;
+    }
+    for (uint32_t seq = from; seq != to; seq++)
+        seq_window_clear(w, seq);
+}
+
+// Keeps reading after the measured window until the sender goes quiet, so its tail lands
+// here instead of turning into ICMP port unreachables (and NoPorts) once the socket closes.
+static void drain_until_quiet(int sockfd, char *packet) {
+    uint64_t start = now_ns(), last_rx = start;
+
+    while (1) {
+        uint64_t now = now_ns();
+        if (now - last_rx >= DRAIN_IDLE_MS * NSEC_PER_MSEC || now - start >= DRAIN_MAX_SEC * NSEC_PER_SEC)
+            break;
+        if (recv(sockfd, packet, RECV_BUF_SIZE, 0) >= 0)
+            last_rx = now;
+        else
+            usleep(1000);
+    }
+}
+
+
+Config* start_tcp_server(int port, Config *received_config, int *control_sock, struct sockaddr_in *peer) {
     int server_fd, client_sock;
     struct sockaddr_in address;
     socklen_t addr_len = sizeof(address);
@@ -43,9 +92,10 @@ Config* start_tcp_server(int port, Config *received_config) {
 
     printf("[Client %d] Connected\n", client_sock);
 
-    // recv header first
+    // recv header first; the connection may stay open as a scenario session, so reads
+    // must not stop short and leave the rest of the Config to be taken for the next Header
     Header header;
-    if (recv(client_sock, &header, sizeof(Header), 0) <= 0) {
+    if (recv_all(client_sock, &header, sizeof(Header)) < 0) {
         perror("Failed to receive header");
         close(client_sock);
         close(server_fd);
@@ -54,9 +104,16 @@ Config* start_tcp_server(int port, Config *received_config) {
 
     // check if the recv header is valid
     int config_length = ntohs(header.msg_length);
+    if (config_length != sizeof(Config)) {
+        fprintf(stderr, "Config of %d bytes, expected %zu: client built from a different version?\n",
+                config_length, sizeof(Config));
+        close(client_sock);
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
     if (config_length > 0) {
         // recv the config 
-        if (recv(client_sock, received_config, config_length, 0) <= 0) {
+        if (recv_all(client_sock, received_config, config_length) < 0) {
             perror("Failed to receive config");
             close(client_sock);
             close(server_fd);
@@ -75,7 +132,7 @@ Config* start_tcp_server(int port, Config *received_config) {
             }
         
             printf("Port: %d\n", received_config->port);
-            printf("UDP Packet Size: %d, Bandwidth: %d\n",
+            printf("UDP Packet Size: %d, Bandwidth: %lu\n",
                    received_config->udp_packet_size,
                    received_config->bandwidth);
         } else {
@@ -83,14 +140,21 @@ Config* start_tcp_server(int port, Config *received_config) {
         }
     }
 
-    close(client_sock);
     close(server_fd);
+    if (control_sock && received_config->scenario) {
+        *control_sock = client_sock;
+        if (peer)
+            *peer = address;
+    } else {
+        close(client_sock);
+    }
     return received_config;
 
 }
 
 
-void udp_receiver(int port, int payload_size, double duration_sec) {
+void udp_receiver(int port, int payload_size, double duration_sec,
+    uint64_t bandwidth_bps, uint64_t rtt_ns, int gro, double warmup_sec, TestResult *result) {
     int sockfd;
     struct sockaddr_in server_addr, client_addr;
     socklen_t client_len;
@@ -99,14 +163,21 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
     uint64_t total_transmitted_bytes = 0;
     uint32_t expected_seq = 0;
     int lost_packets = 0;
+    int out_of_order = 0;
+    int duplicates = 0;
+    uint32_t socket_drops = 0;   // kernel SO_RXQ_OVFL counter, cumulative
+    uint32_t warmup_drops = 0;
+    uint64_t packets_received = 0;
+    UdpSnmp snmp_before, snmp_after;
 
-    struct timeval start_time, current_time, prev_packet_time;
+    uint64_t start_ns, now, prev_packet_ns;
+    uint64_t duration_ns = (uint64_t)(duration_sec * NSEC_PER_SEC);
 
-    // jitter stats
+    // jitter stats, accumulated in ns and converted to us on output
     double sum_jitter = 0.0, sum_jitter_squared = 0.0;
     double avg_jitter = 0.0, jitter_stddev = 0.0;
     int jitter_samples = 0;
-    double prev_arrival_diff = 0.0;
+    int64_t prev_arrival_diff = 0;
 
     // persec stats
     int max_seconds = (int)duration_sec + 2;
@@ -120,6 +191,17 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
     int flags = fcntl(sockfd, F_GETFL, 0);
     fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
 
+    if (gro && enable_udp_gro(sockfd) < 0) {
+        perror("UDP_GRO not available, receiving per packet");
+        gro = 0;
+    }
+
+    if (enable_rxq_ovfl(sockfd) < 0)
+        perror("SO_RXQ_OVFL not available");
+
+    uint64_t rcvbuf_wanted = sockbuf_for_rate(bandwidth_bps, rtt_ns);
+    int rcvbuf = size_socket_buffer(sockfd, SO_RCVBUF, rcvbuf_wanted);
+
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -131,7 +213,8 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
         exit(EXIT_FAILURE);
     }
 
-    packet = malloc(payload_size);
+    // room for a full GRO super-buffer, and so oversized datagrams are not silently truncated
+    packet = malloc(RECV_BUF_SIZE);
     if (!packet) {
         perror("memory allocation failed");
         close(sockfd);
@@ -139,32 +222,84 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
     }
 
     printf("Starting UDP receiver on port %d\n", port);
-    printf("Payload size: %d bytes\n\n", payload_size);
+    printf("Payload size: %d bytes%s\n", payload_size, gro ? " (UDP GRO)" : "");
+    printf("Receive buffer: %d bytes effective (wanted %lu for %.2f Mbps, RTT %.3f ms)\n",
+           rcvbuf, rcvbuf_wanted, bandwidth_bps / 1e6, rtt_ns / 1e6);
+    if (rcvbuf >= 0 && (uint64_t)rcvbuf / 2 < rcvbuf_wanted)
+        printf("Warning: receive buffer capped, raise net.core.rmem_max\n");
+    printf("\n");
+
+    udp_snmp_read(&snmp_before);
 
     client_len = sizeof(client_addr);
     printf("Waiting for first packet...\n");
 
+    // traffic during warm-up is drained but not measured; expected_seq follows it
+    uint64_t wait_start = now_ns(), first_ns = 0;
+    uint64_t warmup_ns = (uint64_t)(warmup_sec * NSEC_PER_SEC);
     while (1) {
-        int n = recvfrom(sockfd, packet, payload_size, 0,
+        int n = recvfrom(sockfd, packet, RECV_BUF_SIZE, 0,
                          (struct sockaddr *)&client_addr, &client_len);
-        if (n > 0) break;
+        uint64_t t = now_ns();
+        if (n >= (int)sizeof(uint32_t)) {
+            if (!first_ns)
+                first_ns = t;
+            // last segment of a GRO buffer; the sender uses payload_size as gso_size
+            expected_seq = ntohl(*(uint32_t *)(packet + (n - 1) / payload_size * payload_size)) + 1;
+            if (t - first_ns >= warmup_ns)
+                break;
+        } else if (!first_ns && t - wait_start >= FIRST_PACKET_TIMEOUT_SEC * NSEC_PER_SEC) {
+            printf("No packet received for %d seconds, giving up\n", FIRST_PACKET_TIMEOUT_SEC);
+            if (result)
+                memset(result, 0, sizeof(*result));
+            free(packet);
+            free(stats);
+            close(sockfd);
+            return;
+        }
     }
+    if (warmup_ns)
+        printf("Warm-up of %.1f s done\n", warmup_sec);
 
-    gettimeofday(&start_time, NULL);
-    prev_packet_time = start_time;
+    SeqWindow *window = malloc(sizeof(SeqWindow));
+    if (!window) {
+        perror("memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    seq_window_init(window, expected_seq);
+
+    // drops are counted from here on; the first cmsg after warm-up carries the baseline
+    int drops_baseline_pending = 1;
+
+    start_ns = now_ns();
+    prev_packet_ns = start_ns;
     printf("Measurement started\n");
 
+    struct iovec iov = { packet, RECV_BUF_SIZE };
+    char control[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int))];
+    uint64_t superbuffers = 0, truncated = 0;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+
+    int reported_sec = 0;
+    uint64_t prev_payload = 0;
+    int prev_lost = 0;
+    uint32_t prev_drops = 0;
+
+    printf("%-13s %12s %10s %13s\n", "Interval", "Goodput", "Seq loss", "Socket drops");
+
     while (1) {
-        gettimeofday(&current_time, NULL);
-        double elapsed = (current_time.tv_sec - start_time.tv_sec) +
-                         (current_time.tv_usec - start_time.tv_usec) / 1e6;
+        msg.msg_controllen = sizeof(control);
+        int n = recvmsg(sockfd, &msg, 0);
 
-        if (elapsed >= duration_sec)
+        // one timestamp per iteration: doubles as the arrival time
+        now = now_ns();
+        if (now - start_ns >= duration_ns)
             break;
 
-        int n = recvfrom(sockfd, packet, payload_size, 0,
-                         (struct sockaddr *)&client_addr, &client_len);
-
         if (n < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 usleep(10);
@@ -174,39 +309,88 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
             break;
         }
 
-        gettimeofday(&current_time, NULL);
-        double current_arrival_diff = (current_time.tv_sec - prev_packet_time.tv_sec) * 1e6 + (current_time.tv_usec - prev_packet_time.tv_usec);
+        // without a gso_size cmsg the buffer holds a single datagram
+        int segment_size = n;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                if (drops_baseline_pending)
+                    warmup_drops = drops;
+                socket_drops = drops - warmup_drops;
+            }
+            else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+        }
+        drops_baseline_pending = 0;
+        if (msg.msg_flags & MSG_TRUNC)
+            truncated++;
+        if (segment_size <= 0 || segment_size > n)
+            segment_size = n;
+        if (segment_size < n)
+            superbuffers++;
+
+        // jitter is per arrival: the segments of a super-buffer arrive together
+        int64_t current_arrival_diff = (int64_t)(now - prev_packet_ns);
 
         if (prev_arrival_diff > 0) {
-            double jitter = fabs(current_arrival_diff - prev_arrival_diff);
+            double jitter = (double)llabs(current_arrival_diff - prev_arrival_diff);
             sum_jitter += jitter;
             sum_jitter_squared += jitter * jitter;
             jitter_samples++;
-            avg_jitter = sum_jitter / jitter_samples;
-
-            if (jitter_samples > 1) {
-                jitter_stddev = sqrt(
-                    (sum_jitter_squared - (sum_jitter * sum_jitter) / jitter_samples) /
-                    (jitter_samples - 1));
-            }
         }
 
         prev_arrival_diff = current_arrival_diff;
-        prev_packet_time = current_time;
+        prev_packet_ns = now;
+
+        uint64_t payload_before = total_payload_bytes;
+
+        for (int off = 0; off < n; off += segment_size) {
+            int seg_len = n - off < segment_size ? n - off : segment_size;
+            if (seg_len < (int)sizeof(uint32_t))
+                break;
+
+            uint32_t seq = ntohl(*(uint32_t *)(packet + off));
+            if (seq > expected_seq) {
+                lost_packets += (seq - expected_seq);
+                seq_window_open_gap(window, expected_seq, seq);
+                seq_window_set(window, seq);
+                expected_seq = seq + 1;
+            } else if (seq < expected_seq) {
+                // outside the window (or sent before measuring) a late packet was never counted lost
+                int tracked = seq >= window->base && expected_seq - seq <= SEQ_WINDOW;
+                if (tracked && seq_window_test(window, seq)) {
+                    duplicates++;
+                    continue;
+                }
+                if (tracked) {
+                    // late arrival of a packet already counted as lost
+                    seq_window_set(window, seq);
+                    lost_packets--;
+                }
+                out_of_order++;
+            } else {
+                seq_window_set(window, seq);
+                expected_seq++;
+            }
 
-        uint32_t seq = ntohl(*(uint32_t *)packet);
-        if (seq != expected_seq) {
-            lost_packets += (seq - expected_seq);
-            expected_seq = seq + 1;
-        } else {
-            expected_seq++;
+            packets_received++;
+            total_payload_bytes += seg_len;
+            total_transmitted_bytes += seg_len + TOTAL_HEADER_SIZE;
         }
 
-        total_payload_bytes += n;
-        total_transmitted_bytes += n + TOTAL_HEADER_SIZE;
-
         // save data per sec
-        int sec_index = (int)elapsed;
+        int sec_index = (int)((now - start_ns) / NSEC_PER_SEC);
+        if (sec_index > reported_sec) {
+            printf("[%4d-%4d s] %7.3f Mbps %10d %13u\n", reported_sec, sec_index,
+                   (payload_before - prev_payload) * 8.0 / ((sec_index - reported_sec) * 1e6),
+                   lost_packets - prev_lost, socket_drops - prev_drops);
+            fflush(stdout);
+            prev_payload = payload_before;
+            prev_lost = lost_packets;
+            prev_drops = socket_drops;
+            reported_sec = sec_index;
+        }
         if (sec_index < max_seconds) {
             stats[sec_index].timestamp = sec_index;
             stats[sec_index].total_payload = total_payload_bytes;
@@ -215,18 +399,44 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
             double seconds_so_far = sec_index + 1;
             stats[sec_index].goodput_mbps = (total_payload_bytes * 8.0) / (seconds_so_far * 1e6);
             stats[sec_index].throughput_mbps = (total_transmitted_bytes * 8.0) / (seconds_so_far * 1e6);
-            stats[sec_index].avg_jitter_us = avg_jitter;
+            stats[sec_index].avg_jitter_us = jitter_samples ? sum_jitter / jitter_samples / NSEC_PER_USEC : 0.0;
+            stats[sec_index].seq_loss = lost_packets;
+            stats[sec_index].socket_drops = socket_drops;
         }
     }
 
-    gettimeofday(&current_time, NULL);
-    double elapsed_seconds = (current_time.tv_sec - start_time.tv_sec) + (current_time.tv_usec - start_time.tv_usec) / 1e6;
+    double elapsed_seconds = ns_to_sec(now_ns() - start_ns);
+    udp_snmp_read(&snmp_after);
+    drain_until_quiet(sockfd, packet);
+
+    if (elapsed_seconds > reported_sec) {
+        printf("[%4d-%4.0f s] %7.3f Mbps %10d %13u\n", reported_sec, elapsed_seconds,
+               (total_payload_bytes - prev_payload) * 8.0 / ((elapsed_seconds - reported_sec) * 1e6),
+               lost_packets - prev_lost, socket_drops - prev_drops);
+    }
+
+    if (jitter_samples > 0) {
+        avg_jitter = sum_jitter / jitter_samples / NSEC_PER_USEC;
+        if (jitter_samples > 1) {
+            jitter_stddev = sqrt(
+                (sum_jitter_squared - (sum_jitter * sum_jitter) / jitter_samples) /
+                (jitter_samples - 1)) / NSEC_PER_USEC;
+        }
+    }
 
     printf("\n=== Measurement Results ===\n");
     printf("Duration:               %.3f seconds\n", elapsed_seconds);
     printf("Total payload:          %lu bytes\n", total_payload_bytes);
     printf("Total transmitted:      %lu bytes\n", total_transmitted_bytes);
     printf("Packet loss:            %d (%.4f%%)\n", lost_packets, (lost_packets * 100.0) / (total_payload_bytes / payload_size + lost_packets));
+    printf("Out of order:           %d\n", out_of_order);
+    printf("Duplicates:             %d\n", duplicates);
+    printf("Socket drops (rcvbuf):  %u\n", socket_drops);
+    printf("Loss before the socket: %d\n", lost_packets > (int)socket_drops ? lost_packets - (int)socket_drops : 0);
+    if (gro)
+        printf("GRO super-buffers:      %lu\n", superbuffers);
+    if (truncated)
+        printf("Truncated datagrams:    %lu\n", truncated);
 
     if (elapsed_seconds > 0) {
         double goodput = (total_payload_bytes * 8) / (elapsed_seconds * 1e6);
@@ -247,6 +457,26 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
         printf("* 3 standard deviations (99.7%% of samples)\n");
     }
 
+    udp_snmp_report(&snmp_before, &snmp_after);
+
+    if (result) {
+        result->packets = packets_received;
+        result->payload_bytes = total_payload_bytes;
+        result->transmitted_bytes = total_transmitted_bytes;
+        result->lost = lost_packets;
+        result->out_of_order = out_of_order;
+        result->socket_drops = socket_drops;
+        result->backpressure = 0;
+        result->elapsed_sec = elapsed_seconds;
+        result->jitter_us = avg_jitter;
+        // the caller collects results; do not clobber output.json
+        free(packet);
+        free(stats);
+        free(window);
+        close(sockfd);
+        return;
+    }
+
 
     FILE *json_file = fopen("output.json", "w");
     if (json_file) {
@@ -256,9 +486,11 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
             if (stats[i].timestamp == 0 && i != 0) continue; 
             fprintf(json_file,
                     "  {\"timestamp\": %.0f, \"total_payload\": %lu, \"total_transmitted\": %lu, "
-                    "\"goodput_mbps\": %.3f, \"throughput_mbps\": %.3f, \"avg_jitter_us\": %.3f}%s\n",
+                    "\"goodput_mbps\": %.3f, \"throughput_mbps\": %.3f, \"avg_jitter_us\": %.3f, "
+                    "\"seq_loss\": %d, \"socket_drops\": %u}%s\n",
                     stats[i].timestamp, stats[i].total_payload, stats[i].total_transmitted,
                     stats[i].goodput_mbps, stats[i].throughput_mbps, stats[i].avg_jitter_us,
+                    stats[i].seq_loss, stats[i].socket_drops,
                     (i < max_seconds - 3) ? "," : "");
         }
         fprintf(json_file, "]\n");
@@ -270,6 +502,7 @@ void udp_receiver(int port, int payload_size, double duration_sec) {
 
     free(packet);
     free(stats);
+    free(window);
     close(sockfd);
 }
 
@@ -337,3 +570,7 @@ void udp_server(int port) {
 }
 
 
+void *udp_server_thread(void *arg) {
+    udp_server(*(int *)arg);
+    return NULL;
+}
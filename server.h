@@ -5,6 +5,16 @@
 #include "requirements.h"
 
 
+#define DRAIN_IDLE_MS 100   // sender considered finished after this much silence
+#define DRAIN_MAX_SEC 5     // upper bound on draining after the measured window
+#define SEQ_WINDOW 65536  // sequence numbers tracked for late arrivals and duplicates
+
+// One bit per sequence number in [expected - SEQ_WINDOW, expected); set once received.
+typedef struct {
+    uint64_t bits[SEQ_WINDOW / 64];
+    uint32_t base;      // first measured sequence number; anything older predates the window
+} SeqWindow;
+
 typedef struct {
     double timestamp;
     uint64_t total_payload;
@@ -12,14 +22,27 @@ typedef struct {
     double goodput_mbps;
     double throughput_mbps;
     double avg_jitter_us;
+    int seq_loss;           // cumulative sequence-gap loss
+    uint32_t socket_drops;  // cumulative kernel receive queue drops
 } PerSecondStats;
 
-Config* start_tcp_server(int port, Config *received_config);
+// With control_sock set, a scenario session keeps the connection open and hands it over;
+// otherwise it is closed once the config has arrived.
+Config* start_tcp_server(int port, Config *received_config, int *control_sock, struct sockaddr_in *peer);
 
 void udp_server(int port);
 
+// pthread entry point for udp_server; arg points to the port
+void *udp_server_thread(void *arg);
+
 // void udp_receiver(int port, int payload_size, uint64_t bytes_to_be_recvd);
-void udp_receiver(int port, int payload_size, double duration_sec);
+// Socket buffers are sized from bandwidth_bps and rtt_ns (see sockbuf_for_rate).
+// gro enables UDP_GRO and splits coalesced buffers back into packets.
+// Traffic in the first warmup_sec after the first packet is drained but not measured,
+// as is anything the sender still sends after the window, until it goes quiet.
+// result, if not NULL, receives the totals instead of output.json being written.
+void udp_receiver(int port, int payload_size, double duration_sec,
+    uint64_t bandwidth_bps, uint64_t rtt_ns, int gro, double warmup_sec, TestResult *result);
 
 uint64_t calculate_total_payload_bytes(int packet_size, uint64_t bandwidth_bps, double duration_sec);
 
@@ -0,0 +1,119 @@
+#include "timing.h"
+#include "requirements.h"
+
+#if TIMING_HAVE_TSC
+#include <cpuid.h>
+#endif
+
+#define CALIBRATION_NS (20 * NSEC_PER_MSEC)
+#define BENCH_ITERATIONS 10000000
+
+TimingState timing = { CLOCK_SRC_MONOTONIC, 0, 0, 0, 0 };
+
+#if TIMING_HAVE_TSC
+// CPUID 0x80000007 EDX bit 8: TSC runs at a constant rate in all P/C-states.
+static int tsc_is_invariant(void) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+        return 0;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx >> 8) & 1;
+}
+
+static int tsc_has_rdtscp(void) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx >> 27) & 1;
+}
+
+static int tsc_calibrate(void) {
+    uint64_t ns0, ns1, tsc0, tsc1;
+
+    ns0 = monotonic_ns();
+    tsc0 = __rdtsc();
+    do {
+        ns1 = monotonic_ns();
+    } while (ns1 - ns0 < CALIBRATION_NS);
+    tsc1 = __rdtsc();
+
+    if (tsc1 <= tsc0)
+        return -1;
+
+    uint64_t hz = (uint64_t)((unsigned __int128)(tsc1 - tsc0) * NSEC_PER_SEC / (ns1 - ns0));
+    // anything outside 100 MHz..20 GHz means a virtualised or broken counter
+    if (hz < 100000000ULL || hz > 20000000000ULL)
+        return -1;
+
+    timing.tsc_hz = hz;
+    timing.mult = (uint64_t)(((unsigned __int128)NSEC_PER_SEC << 32) / hz);
+    timing.tsc_base = tsc1;
+    timing.ns_base = ns1;
+    return 0;
+}
+#endif
+
+
+void timing_init(void) {
+    const char *env = getenv("IPERF_CLOCK");
+
+    timing.source = CLOCK_SRC_MONOTONIC;
+
+#if TIMING_HAVE_TSC
+    if (env && strcmp(env, "monotonic") == 0)
+        return;
+    if (tsc_is_invariant() && tsc_calibrate() == 0)
+        timing.source = CLOCK_SRC_TSC;
+#else
+    (void)env;
+#endif
+}
+
+
+const char *timing_source_name(void) {
+    return timing.source == CLOCK_SRC_TSC ? "tsc" : "clock_monotonic";
+}
+
+
+// Sums the readings so the compiler cannot drop the loop.
+#define BENCH_LOOP(name, expr) do {                                      \
+        volatile uint64_t sink = 0;                                      \
+        uint64_t t0 = monotonic_ns();                                    \
+        for (int i = 0; i < BENCH_ITERATIONS; i++)                       \
+            sink += (expr);                                              \
+        uint64_t t1 = monotonic_ns();                                    \
+        printf("%-24s %8.2f ns/call\n", name,                            \
+               (double)(t1 - t0) / BENCH_ITERATIONS);                    \
+        (void)sink;                                                      \
+    } while (0)
+
+static inline uint64_t gettimeofday_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+void timing_benchmark(void) {
+    printf("=== Timestamp Cost (%d iterations) ===\n", BENCH_ITERATIONS);
+    printf("Selected source:         %s\n", timing_source_name());
+    if (timing.source == CLOCK_SRC_TSC)
+        printf("TSC frequency:           %.3f MHz\n", timing.tsc_hz / 1e6);
+    printf("\n");
+
+    BENCH_LOOP("gettimeofday", gettimeofday_us());
+    BENCH_LOOP("clock_gettime(MONO)", monotonic_ns());
+#if TIMING_HAVE_TSC
+    if (tsc_is_invariant()) {
+        unsigned int aux;
+        BENCH_LOOP("rdtsc", __rdtsc());
+        if (tsc_has_rdtscp())
+            BENCH_LOOP("rdtscp", __rdtscp(&aux));
+    } else {
+        printf("rdtsc                    not invariant, skipped\n");
+    }
+#endif
+    BENCH_LOOP("now_ns", now_ns());
+}
@@ -0,0 +1,63 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#define TIMING_HAVE_TSC 1
+#else
+#define TIMING_HAVE_TSC 0
+#endif
+
+#define NSEC_PER_SEC  1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+typedef enum {
+    CLOCK_SRC_MONOTONIC = 0,  // clock_gettime(CLOCK_MONOTONIC)
+    CLOCK_SRC_TSC             // invariant TSC, calibrated against CLOCK_MONOTONIC
+} ClockSource;
+
+typedef struct {
+    ClockSource source;
+    uint64_t tsc_base;   // TSC value at calibration
+    uint64_t ns_base;    // CLOCK_MONOTONIC ns at tsc_base
+    uint64_t mult;       // ns per tick, 32.32 fixed point
+    uint64_t tsc_hz;     // calibrated TSC frequency
+} TimingState;
+
+extern TimingState timing;
+
+// Picks the clock source and calibrates the TSC. Call once before now_ns().
+// Setting IPERF_CLOCK=monotonic in the environment forces the fallback.
+void timing_init(void);
+
+const char *timing_source_name(void);
+
+// Reports the cost per timestamp of every available source.
+void timing_benchmark(void);
+
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Monotonic nanoseconds, on the same timebase as CLOCK_MONOTONIC.
+static inline uint64_t now_ns(void) {
+#if TIMING_HAVE_TSC
+    if (timing.source == CLOCK_SRC_TSC) {
+        uint64_t ticks = __rdtsc() - timing.tsc_base;
+        return timing.ns_base + (uint64_t)(((unsigned __int128)ticks * timing.mult) >> 32);
+    }
+#endif
+    return monotonic_ns();
+}
+
+static inline double ns_to_sec(uint64_t ns) {
+    return ns / 1e9;
+}
+
+#endif